@@ -1,22 +1,24 @@
 #include "annotate.h"
 #include "wrap.h"
+#include <algorithm>
 
 using namespace pants::cps;
 
-class Counter : boost::noncopyable {
+// every scope shares one map. a callable's names come back out, and the
+// names they shadowed go back in, once the callable has been visited. it
+// also keeps track of which function every variable belongs to, where
+// continuations belong to their function.
+class Scope : boost::noncopyable {
   public:
-    Counter() : m_counter(0) {}
-    unsigned int inc() { return m_counter++; }
-  private:
-    unsigned int m_counter;
-};
-
-class Scope {
-  public:
-    Scope(Counter* counter) : m_counter(counter) {}
+    Scope() : m_counter(0), m_function(0), m_functions(1) {}
     unsigned int newVarid(const Name& name) {
-      unsigned int id = m_counter->inc();
-      m_vars[name] = id;
+      unsigned int id = m_counter++;
+      m_owners.push_back(m_function);
+      std::pair<std::map<Name, unsigned int>::iterator, bool> inserted(
+          m_vars.insert(std::make_pair(name, id)));
+      m_shadowed.push_back(Shadowed(name, !inserted.second,
+          inserted.first->second));
+      inserted.first->second = id;
       return id;
     }
     unsigned int getVarid(const Name& name) const {
@@ -24,17 +26,51 @@ class Scope {
       if(it == m_vars.end()) throw pants::expectation_failure("var missing");
       return it->second;
     }
+    // whether varid belongs to a function other than the current one.
+    bool foreign(unsigned int varid) const {
+      return m_owners[varid] != m_function;
+    }
+    // returns the function to go back to once this one's done.
+    unsigned int enterFunction() {
+      unsigned int outer(m_function);
+      m_function = m_functions++;
+      return outer;
+    }
+    void leaveFunction(unsigned int outer) { m_function = outer; }
+    unsigned int mark() const { return m_shadowed.size(); }
+    void restore(unsigned int mark) {
+      while(m_shadowed.size() > mark) {
+        const Shadowed& last(m_shadowed.back());
+        if(last.existed) {
+          m_vars[last.name] = last.varid;
+        } else {
+          m_vars.erase(last.name);
+        }
+        m_shadowed.pop_back();
+      }
+    }
   private:
-    Counter* m_counter;
+    struct Shadowed {
+      Shadowed(const Name& name_, bool existed_, unsigned int varid_)
+        : name(name_), existed(existed_), varid(varid_) {}
+      Name name;
+      bool existed;
+      unsigned int varid;
+    };
+    unsigned int m_counter;
+    unsigned int m_function;
+    unsigned int m_functions;
+    std::vector<unsigned int> m_owners;
     std::map<Name, unsigned int> m_vars;
+    std::vector<Shadowed> m_shadowed;
 };
 
-void visit_expression(const Scope& scope, pants::annotate::DataStore& store,
+void visit_expression(Scope& scope, pants::annotate::DataStore& store,
     PTR<Expression> expression);
 
 class VarIdValueVisitor : public ValueVisitor {
   public:
-    VarIdValueVisitor(const Scope& scope, pants::annotate::DataStore* store)
+    VarIdValueVisitor(Scope& scope, pants::annotate::DataStore* store)
       : m_scope(scope), m_store(store) {}
 
     void visit(Field* field) { getVar(field->object); }
@@ -47,6 +83,16 @@ class VarIdValueVisitor : public ValueVisitor {
         getVar(func->left_optional_args[i].value);
       for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
         getVar(func->right_optional_args[i].value);
+      // default values are read from inside the function.
+      if(func->function) {
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+          m_store->setCaptured(func->left_optional_args[i].value->getVarid());
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+          m_store->setCaptured(func->right_optional_args[i].value->getVarid());
+      }
+      unsigned int outer(0);
+      if(func->function) outer = m_scope.enterFunction();
+      unsigned int mark(m_scope.mark());
       for(unsigned int i = 0; i < func->left_positional_args.size(); ++i)
         newVar(func->left_positional_args[i]);
       for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
@@ -59,16 +105,20 @@ class VarIdValueVisitor : public ValueVisitor {
       newVar(func->right_arbitrary_arg);
       newVar(func->right_keyword_arg);
       visit_expression(m_scope, *m_store, func->expression);
+      m_scope.restore(mark);
+      if(func->function) m_scope.leaveFunction(outer);
     }
 
   private:
-    Scope m_scope;
+    Scope& m_scope;
     pants::annotate::DataStore* m_store;
 
   protected:
     void getVar(PTR<Variable> var) {
       if(!var) return;
       var->setVarid(m_scope.getVarid(var->name));
+      if(m_scope.foreign(var->getVarid()))
+        m_store->setCaptured(var->getVarid());
     }
     void newVar(PTR<Variable> var) {
       if(!var) return;
@@ -78,8 +128,7 @@ class VarIdValueVisitor : public ValueVisitor {
 
 class VarIdExpressionVisitor : public ExpressionVisitor {
   public:
-    VarIdExpressionVisitor(const Scope& scope,
-        pants::annotate::DataStore* store)
+    VarIdExpressionVisitor(Scope& scope, pants::annotate::DataStore* store)
       : m_scope(scope), m_store(store) {}
 
     void visit(Call* call) {
@@ -116,13 +165,15 @@ class VarIdExpressionVisitor : public ExpressionVisitor {
     }
 
   private:
-    Scope m_scope;
+    Scope& m_scope;
     pants::annotate::DataStore* m_store;
 
   protected:
     void getVar(PTR<Variable> var) {
       if(!var) return;
       var->setVarid(m_scope.getVarid(var->name));
+      if(m_scope.foreign(var->getVarid()))
+        m_store->setCaptured(var->getVarid());
     }
     void newVar(PTR<Variable> var) {
       if(!var) return;
@@ -130,15 +181,14 @@ class VarIdExpressionVisitor : public ExpressionVisitor {
     }
 };
 
-void visit_expression(const Scope& scope, pants::annotate::DataStore& store,
+void visit_expression(Scope& scope, pants::annotate::DataStore& store,
     PTR<Expression> expression) {
   VarIdExpressionVisitor visitor(scope, &store);
   expression->accept(&visitor);
 }
 
 void pants::annotate::varids(PTR<Expression>& cps, DataStore& store) {
-  Counter id_counter;
-  Scope root_scope(&id_counter);
+  Scope root_scope;
   std::set<Name> provided_names;
   pants::wrap::provided_names(provided_names);
   for(std::set<Name>::iterator it(provided_names.begin());
@@ -146,3 +196,528 @@ void pants::annotate::varids(PTR<Expression>& cps, DataStore& store) {
     root_scope.newVarid(*it);
   visit_expression(root_scope, store, cps);
 }
+
+typedef pants::annotate::DataStore::Type Type;
+
+// a variable's type is whatever every value it's given has in common, where
+// an operator on two integers (or two floats) gives another one. a variable
+// declared ahead of its definition (x = 1 comes out as a null and then the
+// 1) leaves the null out, unless something could read it before the
+// definition: anything earlier on in the chain, or in another function.
+class TypeVisitor : public ExpressionVisitor, public ValueVisitor {
+  public:
+    TypeVisitor()
+      : m_function(0), m_functions(1),
+        m_source(pants::annotate::DataStore::UNKNOWN) {}
+
+    void visit(Call* call) {
+      read(call->callable);
+      for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+        read(call->left_positional_args[i]);
+      read(call->left_arbitrary_arg);
+      for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+        read(call->right_positional_args[i]);
+      for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+        read(call->right_optional_args[i].value);
+      read(call->right_arbitrary_arg);
+      read(call->right_keyword_arg);
+      for(unsigned int i = 0; i < call->branches.size(); ++i) {
+        arguments(call->branches[i].get());
+        call->branches[i]->expression->accept(this);
+      }
+      if(!call->continuation) return;
+
+      // a continuation is only ever handed the result of its call.
+      Callable* k(call->continuation.get());
+      PTR<Variable> result;
+      if(k->right_positional_args.size() == 1 &&
+          k->left_positional_args.empty() && k->left_optional_args.empty() &&
+          !k->left_arbitrary_arg && k->right_optional_args.empty() &&
+          !k->right_arbitrary_arg && !k->right_keyword_arg)
+        result = k->right_positional_args[0];
+      if(result && call->binary() && (call->builtin == "lessthan" ||
+          call->builtin == "equals")) {
+        given(result, Source(pants::annotate::DataStore::BOOLEAN));
+      } else if(result && call->binary() && (call->builtin == "add" ||
+          call->builtin == "subtract" || call->builtin == "multiply")) {
+        PTR<Variable> left(call->left_positional_args.empty() ?
+            call->right_positional_args[0] : call->left_positional_args[0]);
+        given(result, Source(left->getVarid(),
+            call->right_positional_args.back()->getVarid()));
+      } else {
+        arguments(k);
+      }
+      k->expression->accept(this);
+    }
+    void visit(Assignment* assignment) {
+      unsigned int varid(assignment->assignee->getVarid());
+      VariableValue* var(dynamic_cast<VariableValue*>(
+          assignment->value.get()));
+      if(assignment->local && var && var->variable->name == NULL_VALUE) {
+        named(assignment->assignee);
+        m_pending[varid] = true;
+        m_declaredIn[varid] = m_function;
+      } else {
+        m_source = Source(pants::annotate::DataStore::UNKNOWN);
+        assignment->value->accept(this);
+        given(assignment->assignee, m_source);
+        if(!assignment->local && m_declaredIn[varid] == m_function)
+          m_pending[varid] = false;
+      }
+      assignment->next_expression->accept(this);
+    }
+    void visit(ObjectMutation* mut) {
+      read(mut->object);
+      read(mut->value);
+      mut->next_expression->accept(this);
+    }
+
+    void visit(Field* field) { read(field->object); }
+    void visit(VariableValue* var) {
+      read(var->variable);
+      if(var->variable->name == Name("true", false) ||
+          var->variable->name == Name("false", false)) {
+        m_source = Source(pants::annotate::DataStore::BOOLEAN);
+      } else {
+        m_source = Source(var->variable->getVarid());
+      }
+    }
+    void visit(Integer*) {
+      m_source = Source(pants::annotate::DataStore::INTEGER);
+    }
+    void visit(String*) {}
+    void visit(Float*) { m_source = Source(pants::annotate::DataStore::FLOAT); }
+    void visit(Callable* func) {
+      unsigned int function(m_function);
+      m_function = m_functions++;
+      for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+        read(func->left_optional_args[i].value);
+      for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+        read(func->right_optional_args[i].value);
+      arguments(func);
+      func->expression->accept(this);
+      m_function = function;
+      // the body's assignments leave their own sources behind.
+      m_source = Source(pants::annotate::DataStore::UNKNOWN);
+    }
+
+    void solve(pants::annotate::DataStore& store) {
+      std::vector<std::vector<unsigned int> > users(m_sources.size());
+      std::vector<int> types(m_sources.size(), UNSET);
+      std::vector<unsigned int> pending;
+      for(unsigned int i = 0; i < m_sources.size(); ++i) {
+        if(m_sources[i].empty()) {
+          types[i] = pants::annotate::DataStore::UNKNOWN;
+          continue;
+        }
+        pending.push_back(i);
+        for(unsigned int j = 0; j < m_sources[i].size(); ++j) {
+          if(!m_sources[i][j].variable) continue;
+          users[m_sources[i][j].left].push_back(i);
+          users[m_sources[i][j].right].push_back(i);
+        }
+      }
+      while(!pending.empty()) {
+        unsigned int varid(pending.back());
+        pending.pop_back();
+        int type(UNSET);
+        for(unsigned int i = 0; i < m_sources[varid].size(); ++i)
+          type = join(type, evaluate(m_sources[varid][i], types));
+        if(type == types[varid]) continue;
+        types[varid] = type;
+        pending.insert(pending.end(), users[varid].begin(),
+            users[varid].end());
+      }
+      for(unsigned int i = 0; i < types.size(); ++i) {
+        if(types[i] != UNSET && types[i] != pants::annotate::DataStore::UNKNOWN)
+          store.setType(i, (Type)types[i]);
+      }
+
+      // frames are laid out by name, so a name only gets a raw slot if all
+      // of its variables can have one.
+      for(std::map<Name, std::vector<unsigned int> >::const_iterator it(
+          m_varids.begin()); it != m_varids.end(); ++it) {
+        Type type(store.type(it->second[0]));
+        if(type != pants::annotate::DataStore::INTEGER &&
+            type != pants::annotate::DataStore::FLOAT)
+          continue;
+        bool raw = true;
+        for(unsigned int i = 0; raw && i < it->second.size(); ++i) {
+          raw = store.type(it->second[i]) == type &&
+              !store.isBoxed(it->second[i]);
+        }
+        if(raw) store.setRawType(it->first, type);
+      }
+    }
+
+  private:
+    // nothing's been given to a variable yet.
+    enum { UNSET = -1 };
+    // a type, or what an operator on two variables gives (or just the one
+    // variable's type).
+    struct Source {
+      Source(Type type_) : type(type_), variable(false) {}
+      Source(unsigned int varid)
+        : type(pants::annotate::DataStore::UNKNOWN), variable(true),
+          result(false), left(varid), right(varid) {}
+      Source(unsigned int left_, unsigned int right_)
+        : type(pants::annotate::DataStore::UNKNOWN), variable(true),
+          result(true), left(left_), right(right_) {}
+      Type type;
+      bool variable;
+      bool result;
+      unsigned int left;
+      unsigned int right;
+    };
+    static int join(int a, int b) {
+      if(a == UNSET) return b;
+      if(b == UNSET || a == b) return a;
+      return pants::annotate::DataStore::UNKNOWN;
+    }
+    static int evaluate(const Source& source, const std::vector<int>& types) {
+      if(!source.variable) return source.type;
+      int left(types[source.left]), right(types[source.right]);
+      if(left == UNSET || right == UNSET) return UNSET;
+      if(!source.result) return left;
+      if(left == right && (left == pants::annotate::DataStore::INTEGER ||
+          left == pants::annotate::DataStore::FLOAT))
+        return left;
+      return pants::annotate::DataStore::UNKNOWN;
+    }
+
+    void slot(unsigned int varid) {
+      if(varid < m_sources.size()) return;
+      m_sources.resize(varid + 1);
+      m_pending.resize(varid + 1, false);
+      m_declaredIn.resize(varid + 1, 0);
+      m_named.resize(varid + 1, false);
+    }
+    // every variable is seen through here, so its name can be looked up.
+    void named(const PTR<Variable>& var) {
+      if(var->getVarid() >= m_sources.size() ||
+          !m_named[var->getVarid()]) {
+        slot(var->getVarid());
+        m_named[var->getVarid()] = true;
+        m_varids[var->name].push_back(var->getVarid());
+      }
+    }
+    void given(const PTR<Variable>& var, const Source& source) {
+      if(!var) return;
+      named(var);
+      if(source.variable) slot(std::max(source.left, source.right));
+      m_sources[var->getVarid()].push_back(source);
+    }
+    void read(const PTR<Variable>& var) {
+      if(!var) return;
+      named(var);
+      if(m_pending[var->getVarid()])
+        given(var, Source(pants::annotate::DataStore::UNKNOWN));
+    }
+    // arguments can be given anything.
+    void arguments(Callable* func) {
+      Source anything(pants::annotate::DataStore::UNKNOWN);
+      for(unsigned int i = 0; i < func->left_positional_args.size(); ++i)
+        given(func->left_positional_args[i], anything);
+      for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+        given(func->left_optional_args[i].key, anything);
+      given(func->left_arbitrary_arg, anything);
+      for(unsigned int i = 0; i < func->right_positional_args.size(); ++i)
+        given(func->right_positional_args[i], anything);
+      for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+        given(func->right_optional_args[i].key, anything);
+      given(func->right_arbitrary_arg, anything);
+      given(func->right_keyword_arg, anything);
+    }
+
+    unsigned int m_function;
+    unsigned int m_functions;
+    Source m_source;
+    std::vector<std::vector<Source> > m_sources;
+    std::vector<bool> m_pending;
+    std::vector<unsigned int> m_declaredIn;
+    std::vector<bool> m_named;
+    std::map<Name, std::vector<unsigned int> > m_varids;
+};
+
+void pants::annotate::types(PTR<Expression>& cps, DataStore& store) {
+  TypeVisitor visitor;
+  cps->accept(&visitor);
+  visitor.solve(store);
+}
+
+static void names_in_callable(Callable* func, std::set<Name>& free_names,
+    std::set<Name>& frame_names, bool* frame_escapes, bool in_branch,
+    pants::annotate::DataStore* store);
+
+// every expression is visited with empty name sets, and visits the rest of
+// its chain before adding names of its own, so a callable at the end of a
+// chain can fill the sets in place. a function's frame escapes if any of
+// its continuations (which all share it) go anywhere but an operator's
+// builtin, which only ever calls them straight back. an if that isn't
+// written in place hands its continuation on to a block, which can hold on
+// to it. a while loop written in place hands continuations into its frame
+// to its test and body (or to what they call, and to a break or continue
+// that isn't called right in the body), even as a tail call, and so does a
+// tail call in the branch of an if that isn't one itself, since the branch
+// returns to the if's continuation.
+class NameExpressionVisitor : public ExpressionVisitor {
+  public:
+    NameExpressionVisitor(std::set<Name>& free_names,
+        std::set<Name>& frame_names, bool* frame_escapes, bool in_branch,
+        pants::annotate::DataStore* store)
+      : m_freeNames(free_names), m_frameNames(frame_names),
+        m_frameEscapes(frame_escapes), m_inBranch(in_branch),
+        m_store(store) {}
+
+    void visit(Call* call) {
+      bool calls_back(!call->builtin.empty() &&
+          !(call->builtin == "if" && call->branches.empty()));
+      if(call->builtin == "while") *m_frameEscapes = true;
+      if(m_inBranch && call->tail_call && !calls_back)
+        *m_frameEscapes = true;
+      if(call->continuation) {
+        if(!calls_back) *m_frameEscapes = true;
+        names_in_callable(call->continuation.get(), m_freeNames, m_frameNames,
+            m_frameEscapes, m_inBranch, m_store);
+      }
+      for(unsigned int i = 0; i < call->branches.size(); ++i) {
+        names_in_callable(call->branches[i].get(), m_freeNames, m_frameNames,
+            m_frameEscapes, m_inBranch || !!call->continuation ||
+            call->builtin == "while", m_store);
+      }
+      addName(call->callable);
+      for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+        addName(call->left_positional_args[i]);
+      addName(call->left_arbitrary_arg);
+      for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+        addName(call->right_positional_args[i]);
+      for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+        addName(call->right_optional_args[i].value);
+      addName(call->right_arbitrary_arg);
+      addName(call->right_keyword_arg);
+      m_freeNames.insert(DYNAMIC_VARS);
+      if(call->tail_call) m_freeNames.insert(CONTINUATION);
+    }
+    void visit(Assignment* assignment);
+    void visit(ObjectMutation* mut) {
+      mut->next_expression->accept(this);
+      addName(mut->object);
+      addName(mut->value);
+    }
+
+  private:
+    std::set<Name>& m_freeNames;
+    std::set<Name>& m_frameNames;
+    bool* m_frameEscapes;
+    bool m_inBranch;
+    pants::annotate::DataStore* m_store;
+
+  protected:
+    void addName(PTR<Variable> var) {
+      if(!var) return;
+      m_freeNames.insert(var->name);
+    }
+};
+
+class NameValueVisitor : public ValueVisitor {
+  public:
+    NameValueVisitor(std::set<Name>& free_names,
+        pants::annotate::DataStore* store)
+      : m_freeNames(free_names), m_store(store) {}
+
+    void visit(Field* field) { m_freeNames.insert(field->object->name); }
+    void visit(VariableValue* var) {
+      m_freeNames.insert(var->variable->name);
+    }
+    void visit(Integer* integer) {}
+    void visit(String* str) {}
+    void visit(Float* floating) {}
+    void visit(Callable* func) {
+      std::set<Name> free_names;
+      std::set<Name> frame_names;
+      names_in_callable(func, free_names, frame_names, NULL, false, m_store);
+      m_freeNames.insert(free_names.begin(), free_names.end());
+    }
+
+  private:
+    std::set<Name>& m_freeNames;
+    pants::annotate::DataStore* m_store;
+};
+
+void NameExpressionVisitor::visit(Assignment* assignment) {
+  assignment->next_expression->accept(this);
+  NameValueVisitor visitor(m_freeNames, m_store);
+  assignment->value->accept(&visitor);
+  if(assignment->local) {
+    m_freeNames.erase(assignment->assignee->name);
+    m_frameNames.insert(assignment->assignee->name);
+  } else {
+    m_freeNames.insert(assignment->assignee->name);
+  }
+}
+
+// frame_escapes is the enclosing function's, and only used by continuations,
+// as is in_branch.
+static void names_in_callable(Callable* func, std::set<Name>& free_names,
+    std::set<Name>& frame_names, bool* frame_escapes, bool in_branch,
+    pants::annotate::DataStore* store) {
+  store->addCallable(PTR<Callable>(func));
+  bool own_frame_escapes(false);
+  if(func->function) {
+    frame_escapes = &own_frame_escapes;
+    in_branch = false;
+  }
+  NameExpressionVisitor visitor(free_names, frame_names, frame_escapes,
+      in_branch, store);
+  func->expression->accept(&visitor);
+  if(func->function) func->frame_escapes = own_frame_escapes;
+  std::set<Name> args;
+  func->arg_names(args);
+  for(std::set<Name>::iterator it(args.begin()); it != args.end(); ++it) {
+    free_names.erase(*it);
+    frame_names.insert(*it);
+  }
+  for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+    free_names.insert(func->left_optional_args[i].value->name);
+  for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+    free_names.insert(func->right_optional_args[i].value->name);
+  if(func->function) func->setNames(free_names, frame_names);
+}
+
+// sharing an environment or frame keeps everything else in it alive for as
+// long as the closure is, so it's only done if that's at most this many
+// names over twice what the closure needs.
+static const unsigned int SHARED_ENVIRONMENT_SLACK = 16;
+
+static bool small_enough(const std::set<Name>& needed,
+    const std::set<Name>& shared) {
+  return shared.size() <= 2 * needed.size() + SHARED_ENVIRONMENT_SLACK;
+}
+
+static bool subset(const std::set<Name>& names, const std::set<Name>& of) {
+  return std::includes(of.begin(), of.end(), names.begin(), names.end());
+}
+
+// counts how many times each frame name of a function is bound, and which
+// are bound before its first call. a continuation can run again, rebinding
+// its arguments and assignments, but nothing before the first call can.
+class BindingVisitor : public ExpressionVisitor {
+  public:
+    BindingVisitor(std::map<Name, unsigned int>& bindings,
+        std::set<Name>* early)
+      : m_bindings(bindings), m_early(early) {}
+
+    void visit(Call* call) {
+      BindingVisitor visitor(m_bindings, NULL);
+      for(unsigned int i = 0; i < call->branches.size(); ++i)
+        call->branches[i]->expression->accept(&visitor);
+      if(!call->continuation) return;
+      std::set<Name> args;
+      call->continuation->arg_names(args);
+      for(std::set<Name>::iterator it(args.begin()); it != args.end(); ++it)
+        ++m_bindings[*it];
+      call->continuation->expression->accept(&visitor);
+    }
+    void visit(Assignment* assignment) {
+      if(assignment->local) {
+        ++m_bindings[assignment->assignee->name];
+        if(m_early) m_early->insert(assignment->assignee->name);
+      }
+      assignment->next_expression->accept(this);
+    }
+    void visit(ObjectMutation* mut) { mut->next_expression->accept(this); }
+
+  private:
+    std::map<Name, unsigned int>& m_bindings;
+    std::set<Name>* m_early;
+};
+
+// the frame names whose slots never change once a closure could see them.
+static void settled_names(Callable* func, std::set<Name>& settled) {
+  std::map<Name, unsigned int> bindings;
+  std::set<Name> early;
+  func->arg_names(early);
+  for(std::set<Name>::iterator it(early.begin()); it != early.end(); ++it)
+    ++bindings[*it];
+  BindingVisitor visitor(bindings, &early);
+  func->expression->accept(&visitor);
+  for(std::set<Name>::iterator it(early.begin()); it != early.end(); ++it) {
+    if(bindings[*it] == 1 &&
+        func->getFreeNames().find(*it) == func->getFreeNames().end())
+      settled.insert(*it);
+  }
+}
+
+// top-down, since a function's choice depends on what its maker chose. a
+// function made at the top level always gets a copy.
+class EnvironmentVisitor : public ExpressionVisitor, public ValueVisitor {
+  public:
+    EnvironmentVisitor(Callable* maker) : m_maker(maker) {
+      if(m_maker && m_maker->frame_escapes)
+        settled_names(m_maker, m_settled);
+    }
+
+    void visit(Call* call) {
+      if(call->continuation) call->continuation->expression->accept(this);
+      for(unsigned int i = 0; i < call->branches.size(); ++i)
+        call->branches[i]->expression->accept(this);
+    }
+    void visit(Assignment* assignment) {
+      assignment->value->accept(this);
+      assignment->next_expression->accept(this);
+    }
+    void visit(ObjectMutation* mut) { mut->next_expression->accept(this); }
+
+    void visit(Field* field) {}
+    void visit(VariableValue* var) {}
+    void visit(Integer* integer) {}
+    void visit(String* str) {}
+    void visit(Float* floating) {}
+    void visit(Callable* func) {
+      choose(func);
+      EnvironmentVisitor visitor(func);
+      func->expression->accept(&visitor);
+    }
+
+  private:
+    // the maker's environment is only good if none of the names were
+    // rebound on the way, and its frame only if nothing goes back into the
+    // slots (or the frame back onto its pool).
+    void choose(Callable* func) {
+      if(!m_maker || func->getFreeNames().empty()) return;
+      const std::set<Name>& needed(func->getFreeNames());
+      bool rebound(false);
+      for(std::set<Name>::const_iterator it(needed.begin());
+          it != needed.end(); ++it) {
+        if(m_maker->getFrameNames().find(*it) !=
+            m_maker->getFrameNames().end())
+          rebound = true;
+      }
+      if(!rebound && subset(needed, m_maker->getFreeNames()) &&
+          small_enough(needed, m_maker->getEnvironmentNames())) {
+        func->setEnvironment(Callable::SHARED_ENV,
+            m_maker->getEnvironmentNames());
+      } else if(subset(needed, m_settled) &&
+          small_enough(needed, m_maker->getFrameNames())) {
+        func->setEnvironment(Callable::SHARED_FRAME,
+            m_maker->getFrameNames());
+      }
+    }
+
+  private:
+    Callable* m_maker;
+    std::set<Name> m_settled;
+};
+
+void pants::annotate::names(PTR<Expression>& cps, DataStore& store) {
+  std::set<Name> free_names;
+  std::set<Name> frame_names;
+  // the top level isn't a function, so nothing comes of this one.
+  bool frame_escapes(false);
+  NameExpressionVisitor visitor(free_names, frame_names, &frame_escapes,
+      false, &store);
+  cps->accept(&visitor);
+  store.setNames(free_names, frame_names);
+  EnvironmentVisitor environments(NULL);
+  cps->accept(&environments);
+}
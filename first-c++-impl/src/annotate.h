@@ -10,7 +10,7 @@ namespace annotate {
   class DataStore : boost::noncopyable {
     public:
       DataStore() {}
-      bool isMutated(unsigned int varid) {
+      bool isMutated(unsigned int varid) const {
         std::map<unsigned int, bool>::const_iterator it(m_mutability.find(varid));
         if(it == m_mutability.end()) return false;
         return it->second;
@@ -18,11 +18,71 @@ namespace annotate {
       void setMutated(unsigned int varid) {
         m_mutability[varid] = true;
       }
+      // whether a function other than the one a variable belongs to uses it.
+      // a mutated variable only needs a cell if it's captured, otherwise it
+      // can live right in its frame. both filled in by varids.
+      void setCaptured(unsigned int varid) { m_captured.insert(varid); }
+      bool isBoxed(unsigned int varid) const {
+        return isMutated(varid) && m_captured.find(varid) != m_captured.end();
+      }
+      // what a variable is known to hold every time it's read. filled in by
+      // types.
+      enum Type { UNKNOWN, INTEGER, FLOAT, BOOLEAN };
+      Type type(unsigned int varid) const {
+        std::map<unsigned int, Type>::const_iterator it(m_types.find(varid));
+        if(it == m_types.end()) return UNKNOWN;
+        return it->second;
+      }
+      void setType(unsigned int varid, Type type) { m_types[varid] = type; }
+      // INTEGER or FLOAT for a name that's that type for every variable
+      // going by it, none of which needs a cell, so compile can keep it as a
+      // raw long long or double. filled in by types.
+      Type rawType(const pants::cps::Name& name) const {
+        std::map<pants::cps::Name, Type>::const_iterator it(
+            m_rawTypes.find(name));
+        if(it == m_rawTypes.end()) return UNKNOWN;
+        return it->second;
+      }
+      void setRawType(const pants::cps::Name& name, Type type) {
+        m_rawTypes[name] = type;
+      }
+      // every callable in the program, outermost first, along with the free
+      // and frame names of the top level. filled in by names.
+      void addCallable(PTR<pants::cps::Callable> callable) {
+        m_callables.push_back(callable);
+      }
+      const std::vector<PTR<pants::cps::Callable> >& callables() const {
+        return m_callables;
+      }
+      void setNames(const std::set<pants::cps::Name>& free_names,
+          const std::set<pants::cps::Name>& frame_names) {
+        m_freeNames = free_names;
+        m_frameNames = frame_names;
+      }
+      const std::set<pants::cps::Name>& freeNames() const {
+        return m_freeNames;
+      }
+      const std::set<pants::cps::Name>& frameNames() const {
+        return m_frameNames;
+      }
     private:
       std::map<unsigned int, bool> m_mutability;
+      std::map<unsigned int, Type> m_types;
+      std::map<pants::cps::Name, Type> m_rawTypes;
+      std::set<unsigned int> m_captured;
+      std::vector<PTR<pants::cps::Callable> > m_callables;
+      std::set<pants::cps::Name> m_freeNames;
+      std::set<pants::cps::Name> m_frameNames;
   };
 
   void varids(PTR<pants::cps::Expression>& cps, DataStore& store);
+  // works out which variables only ever hold integers, floats or booleans,
+  // and which names can be kept as raw numbers.
+  // the operators' results are followed, so run it after optimize::cps.
+  void types(PTR<pants::cps::Expression>& cps, DataStore& store);
+  // works out free and frame names for every function in one bottom-up
+  // pass. run it last, after anything that rewrites the cps.
+  void names(PTR<pants::cps::Expression>& cps, DataStore& store);
 
 }}
 
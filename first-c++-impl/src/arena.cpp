@@ -0,0 +1,80 @@
+#include "arena.h"
+#include <cstdlib>
+#include <new>
+
+using namespace pants;
+
+static const size_t BLOCK_SIZE = 64 * 1024;
+static const size_t ALIGNMENT = 16;
+
+Arena::Arena() : m_next(NULL), m_end(NULL), m_bytes(0) {}
+
+Arena::~Arena() { clear(); }
+
+void* Arena::allocate(size_t size) {
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  char* storage;
+  if(size > BLOCK_SIZE / 4) {
+    storage = (char*)malloc(size);
+    if(!storage) throw std::bad_alloc();
+    m_blocks.push_back(storage);
+  } else {
+    if(size > (size_t)(m_end - m_next)) {
+      m_next = (char*)malloc(BLOCK_SIZE);
+      if(!m_next) throw std::bad_alloc();
+      m_end = m_next + BLOCK_SIZE;
+      m_blocks.push_back(m_next);
+    }
+    storage = m_next;
+    m_next += size;
+  }
+  m_bytes += size;
+  // the node's constructor claims this when it calls adopt. constructor
+  // arguments can allocate nodes of their own in the meantime, hence the
+  // stack.
+  m_pending.push_back(std::make_pair(storage, storage + size));
+  return storage;
+}
+
+void Arena::adopt(Node* node) {
+  char* address = (char*)node;
+  for(size_t i = m_pending.size(); i > 0; --i) {
+    if(m_pending[i-1].first <= address && address < m_pending[i-1].second) {
+      m_pending.erase(m_pending.begin() + (i - 1));
+      m_nodes.push_back(node);
+      return;
+    }
+  }
+}
+
+// a constructor threw. forget about the node; its memory goes with the rest
+// of the arena.
+void Arena::release(void* storage, size_t size) {
+  char* begin = (char*)storage;
+  char* end = begin + size;
+  for(size_t i = m_pending.size(); i > 0; --i) {
+    if(m_pending[i-1].first == begin) {
+      m_pending.erase(m_pending.begin() + (i - 1));
+      return;
+    }
+  }
+  for(size_t i = m_nodes.size(); i > 0; --i) {
+    char* address = (char*)m_nodes[i-1];
+    if(begin <= address && address < end) {
+      m_nodes[i-1] = NULL;
+      return;
+    }
+  }
+}
+
+void Arena::clear() {
+  for(size_t i = m_nodes.size(); i > 0; --i) {
+    if(m_nodes[i-1]) m_nodes[i-1]->~Node();
+  }
+  for(size_t i = 0; i < m_blocks.size(); ++i) free(m_blocks[i]);
+  std::vector<Node*>().swap(m_nodes);
+  std::vector<char*>().swap(m_blocks);
+  m_pending.clear();
+  m_next = m_end = NULL;
+  m_bytes = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace pants {
+
+  // a non-owning pointer to an arena node. it has the parts of the
+  // boost::shared_ptr interface the compiler uses, but no reference count;
+  // the arena the node lives in owns it.
+  template <class T>
+  class Ptr {
+    typedef T* Ptr::*unspecified_bool_type;
+    public:
+      Ptr() : m_ptr(0) {}
+      explicit Ptr(T* ptr) : m_ptr(ptr) {}
+      template <class U> Ptr(const Ptr<U>& other) : m_ptr(other.get()) {}
+      T* get() const { return m_ptr; }
+      void reset(T* ptr = 0) { m_ptr = ptr; }
+      T& operator*() const { return *m_ptr; }
+      T* operator->() const { return m_ptr; }
+      operator unspecified_bool_type() const { return m_ptr ? &Ptr::m_ptr : 0; }
+    private:
+      T* m_ptr;
+  };
+
+  template <class T, class U>
+  inline bool operator==(const Ptr<T>& lhs, const Ptr<U>& rhs)
+    { return lhs.get() == rhs.get(); }
+  template <class T, class U>
+  inline bool operator!=(const Ptr<T>& lhs, const Ptr<U>& rhs)
+    { return lhs.get() != rhs.get(); }
+  template <class T, class U>
+  inline bool operator<(const Ptr<T>& lhs, const Ptr<U>& rhs)
+    { return lhs.get() < rhs.get(); }
+
+  class Node;
+
+  // nodes are bump allocated out of large blocks and never freed one at a
+  // time. clearing the arena runs every node's destructor (the strings and
+  // vectors inside them still live on the heap) and frees the blocks.
+  class Arena : boost::noncopyable {
+    public:
+      Arena();
+      ~Arena();
+      void* allocate(size_t size);
+      void adopt(Node* node);
+      void release(void* storage, size_t size);
+      void clear();
+      size_t bytes() const { return m_bytes; }
+      size_t nodes() const { return m_nodes.size(); }
+    private:
+      std::vector<char*> m_blocks;
+      char* m_next;
+      char* m_end;
+      std::vector<std::pair<char*, char*> > m_pending;
+      std::vector<Node*> m_nodes;
+      size_t m_bytes;
+  };
+
+  class Node {
+    public:
+      virtual ~Node() {}
+  };
+
+  // base for every node of a given compiler phase. they all come out of the
+  // phase's arena, so a phase can be thrown away in one go once the next
+  // phase has been built from it. nodes that are copied or constructed by
+  // value (rather than with new) are not adopted by the arena.
+  template <class Phase>
+  class ArenaNode : public Node {
+    public:
+      static Arena& arena() {
+        static Arena phase_arena;
+        return phase_arena;
+      }
+      static void* operator new(size_t size)
+        { return arena().allocate(size); }
+      static void operator delete(void* storage, size_t size)
+        { arena().release(storage, size); }
+    protected:
+      ArenaNode() { arena().adopt(this); }
+      ArenaNode(const ArenaNode&) : Node() { arena().adopt(this); }
+      // copies nothing on purpose: arena ownership is fixed at construction.
+      ArenaNode& operator=(const ArenaNode&) { return *this; }
+  };
+
+}
+
+#endif
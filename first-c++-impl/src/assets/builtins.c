@@ -999,3 +999,45 @@ static inline void builtin_modulo(union Value* val1, union Value* val2,
       return;
   }
 }
+
+// everything a running while loop needs between calls to its test and body.
+// the loop's continuations carry it around as their environment.
+struct WhileLoop {
+  void* env;
+  union Value test;
+  union Value body;
+  union Value continuation;
+  union Value dynamic_vars;
+  union Value body_dynamic_vars;
+};
+
+// a loop's body runs with next (a continuation taking whether to keep
+// going) bound to while_var, which is all break and continue need.
+static inline union Value while_body_dynamic_vars(union Value dynamic_vars,
+    union Value while_var, void* next, void* env, void* frame) {
+  union Value closure, body_dynamic_vars;
+  closure.t = CLOSURE;
+  closure.closure.func = next;
+  closure.closure.env = env;
+  closure.closure.frame = frame;
+  copy_object(&dynamic_vars, &body_dynamic_vars);
+  set_field(body_dynamic_vars.object.data,
+      *((struct ByteArray*)while_var.object.data->env), closure);
+  seal_object(body_dynamic_vars.object.data);
+  return body_dynamic_vars;
+}
+
+// env is what to go back to once the loop is done.
+static inline struct WhileLoop* start_while_loop(union Value test,
+    union Value body, union Value dynamic_vars, union Value while_var,
+    void* next, void* env, void* frame) {
+  struct WhileLoop* loop = GC_MALLOC(sizeof(struct WhileLoop));
+  loop->env = env;
+  loop->test = test;
+  loop->body = body;
+  loop->continuation.t = NIL;
+  loop->dynamic_vars = dynamic_vars;
+  loop->body_dynamic_vars = while_body_dynamic_vars(dynamic_vars, while_var,
+      next, loop, frame);
+  return loop;
+}
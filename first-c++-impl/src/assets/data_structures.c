@@ -211,14 +211,50 @@ static inline void shift_values(struct Array* array,
   array->size += amount_to_right;
 }
 
-static inline unsigned int binary_search(struct ByteArray key,
-    struct ByteArray* key_array, unsigned int key_count) {
-  // TODO
+// keyword arguments on their way to a function, in the order they were given,
+// so a later one overrides an earlier one with the same name. each carries
+// the hash of its name, worked out ahead of time when the name is known then.
+struct Keyword {
+  struct ByteArray key;
+  unsigned long long hash;
+  union Value value;
+};
+
+struct KeywordArray {
+  unsigned int size;
+  unsigned int highwater;
+  struct Keyword* data;
+};
+
+static inline void initialize_keywords(struct KeywordArray* keywords) {
+  keywords->size = 0;
+  keywords->highwater = MIN_ARRAY_SIZE;
+  keywords->data = GC_MALLOC(sizeof(struct Keyword) * MIN_ARRAY_SIZE);
+}
+
+static inline void add_keyword(struct KeywordArray* keywords,
+    struct ByteArray key, unsigned long long hash, union Value value) {
+  if(keywords->size == keywords->highwater) {
+    unsigned int i = 0;
+    struct Keyword* new_data;
+    keywords->highwater *= 2;
+    new_data = GC_MALLOC(sizeof(struct Keyword) * keywords->highwater);
+    for(i = 0; i < keywords->size; ++i) new_data[i] = keywords->data[i];
+    keywords->data = new_data;
+  }
+  keywords->data[keywords->size].key = key;
+  keywords->data[keywords->size].hash = hash;
+  keywords->data[keywords->size].value = value;
+  ++keywords->size;
+}
+
+// 64 bit fnv-1a. the compiler works out the same thing for names it knows.
+static inline unsigned long long hash_key(struct ByteArray key) {
   unsigned int i = 0;
-  for(; i < key_count; ++i) {
-    if(safe_strcmp(key, key_array[i]) == 0) {
-      return i;
-    }
+  unsigned long long hash = 14695981039346656037ULL;
+  for(i = 0; i < key.size; ++i) {
+    hash ^= (unsigned char)key.data[i];
+    hash *= 1099511628211ULL;
   }
-  return key_count;
+  return hash;
 }
@@ -39,14 +39,8 @@ unless = {|lblock:null; test, rblock:null|
   } { if test { null } lblock }
 }
 
-while_dynamic_var = DynamicVar()
-while = {|test, body|
-  if test() {
-    if { while_dynamic_var.call cont { body(); true } }() {
-      while test body
-    }
-  }
-}
+# while is a builtin, which hands its body a continuation to say whether to
+# keep going through while_dynamic_var.
 break = { while_dynamic_var.get() false }
 continue = { while_dynamic_var.get() true }
 # TODO: actually clear this out of the scope or something
@@ -10,7 +10,7 @@ int gc_main(int argc, char **argv) {
   union Value continuation;
   union Value dynamic_vars;
   struct ObjectData dynamic_vars_data;
-  struct ObjectData keyword_args;
+  struct KeywordArray keyword_args;
   struct ObjectIterator it;
 
   // This strategy imposes an argument limit of 64
@@ -22,7 +22,7 @@ int gc_main(int argc, char **argv) {
 
   initialize_array(&right_positional_args);
   initialize_array(&left_positional_args);
-  initialize_object(&keyword_args);
+  initialize_keywords(&keyword_args);
 
   globals.c_continuation.t = CLOSURE;
   globals.c_continuation.closure.func = &&c_halt;
@@ -49,6 +49,7 @@ int gc_main(int argc, char **argv) {
   DEFINE_BUILTIN(println)
   DEFINE_BUILTIN(readln)
   DEFINE_BUILTIN(if)
+  DEFINE_BUILTIN(while)
   DEFINE_BUILTIN(lessthan)
   DEFINE_BUILTIN(equals)
   DEFINE_BUILTIN(add)
@@ -83,6 +84,13 @@ int gc_main(int argc, char **argv) {
 finish_setup:
   globals.c_throw__dynamic__var = right_positional_args.data[0];
   right_positional_args.size = 0;
+  continuation.t = CLOSURE;
+  continuation.closure.func = &&finish_while_setup;
+  goto c_DynamicVar;
+
+finish_while_setup:
+  globals.c_while__dynamic__var = right_positional_args.data[0];
+  right_positional_args.size = 0;
   dynamic_vars = globals.c_dynamic__vars;
   dest.t = CLOSURE;
   dest.closure.env = NULL;
@@ -103,10 +111,24 @@ finish_setup:
   env = callable.closure.env; \
   frame = callable.closure.frame; \
   goto *callable.closure.func;
+// a frame nothing can hold on to once its function returns goes on a free
+// list of frames its size, for the next call to pick up.
+#define POP_FRAME(pool, size) \
+  if(pool) { \
+    frame = pool; \
+    pool = *(void**)frame; \
+  } else { \
+    frame = GC_MALLOC(size); \
+  }
+#define PUSH_FRAME(pool) \
+  *(void**)frame = pool; \
+  pool = frame;
 #define THROW_ERROR(current_dynamic_vars, val) \
   right_positional_args.size = 1; \
   right_positional_args.data[0] = val; \
-  initialize_object(&keyword_args); \
+  keyword_args.size = 0; \
+  named_slots[0] = 0; \
+  named_slots[1] = 0; \
   if(!get_field(current_dynamic_vars.object.data, \
       *((struct ByteArray*)globals.c_throw__dynamic__var.object.data->env), \
       &dest)) { \
@@ -147,7 +169,7 @@ finish_setup:
     THROW_ERROR(dynamic_vars, dest); \
   }
 #define NO_KEYWORD_ARGUMENTS \
-  if(keyword_args.tree != NULL) { \
+  if(keyword_args.size != 0) { \
     dest = make_c_string("no keyword arguments supported for this builtin!"); \
     THROW_ERROR(dynamic_vars, dest); \
   }
@@ -430,6 +452,60 @@ c_modulo:
   continuation.t = NIL;
   CALL_FUNC(dest)
 
+// the loop itself lives in env, a struct WhileLoop.
+c_while:
+  REQUIRED_FUNCTION(continuation)
+  NO_KEYWORD_ARGUMENTS
+  MAX_LEFT_ARGS(0)
+  MIN_RIGHT_ARGS(2)
+  MAX_RIGHT_ARGS(2)
+  REQUIRED_FUNCTION(right_positional_args.data[0])
+  REQUIRED_FUNCTION(right_positional_args.data[1])
+  env = start_while_loop(right_positional_args.data[0],
+      right_positional_args.data[1], dynamic_vars,
+      globals.c_while__dynamic__var, &&c_while_next, NULL, NULL);
+  ((struct WhileLoop*)env)->continuation = continuation;
+c_while_test:
+  continuation.t = CLOSURE;
+  continuation.closure.func = &&c_while_tested;
+  continuation.closure.env = env;
+  continuation.closure.frame = NULL;
+  dynamic_vars = ((struct WhileLoop*)env)->dynamic_vars;
+  left_positional_args.size = 0;
+  right_positional_args.size = 0;
+  dest = ((struct WhileLoop*)env)->test;
+  CALL_FUNC(dest)
+c_while_tested:
+  dest.t = NIL;
+  if(builtin_istrue(&right_positional_args.data[0], &dest)) {
+    continuation.t = CLOSURE;
+    continuation.closure.func = &&c_while_test;
+    continuation.closure.env = env;
+    continuation.closure.frame = NULL;
+    dynamic_vars = ((struct WhileLoop*)env)->body_dynamic_vars;
+    left_positional_args.size = 0;
+    right_positional_args.size = 0;
+    dest = ((struct WhileLoop*)env)->body;
+    CALL_FUNC(dest)
+  }
+  if(dest.t != NIL) {
+    THROW_ERROR(((struct WhileLoop*)env)->dynamic_vars, dest);
+  }
+  goto c_while_done;
+c_while_next:
+  dest.t = NIL;
+  if(builtin_istrue(&right_positional_args.data[0], &dest)) goto c_while_test;
+  if(dest.t != NIL) {
+    THROW_ERROR(((struct WhileLoop*)env)->dynamic_vars, dest);
+  }
+c_while_done:
+  left_positional_args.size = 0;
+  right_positional_args.size = 1;
+  right_positional_args.data[0].t = NIL;
+  dest = ((struct WhileLoop*)env)->continuation;
+  continuation.t = NIL;
+  CALL_FUNC(dest)
+
 c_new__object:
   REQUIRED_FUNCTION(continuation)
   NO_KEYWORD_ARGUMENTS
@@ -17,6 +17,10 @@ namespace ast {
   struct ArbitraryOutArgument; struct KeywordOutArgument;
   struct OpenCall; struct ClosedCall; struct Field;
 
+  // every ast node lives in the ast arena.
+  struct Phase;
+  typedef pants::ArenaNode<Phase> Node;
+
   struct AstVisitor {
     virtual void visit(Term*) = 0;
     virtual void visit(Application*) = 0;
@@ -37,35 +41,35 @@ namespace ast {
     virtual void visit(Index*) = 0;
   };
 
-  struct Expression {
+  struct Expression : public Node {
     virtual ~Expression() {}
     virtual std::string format() const = 0;
     virtual void accept(AstVisitor* visitor) = 0;
     protected: Expression() {} };
 
-  struct Value {
+  struct Value : public Node {
     virtual ~Value() {}
     virtual std::string format() const = 0;
     virtual void accept(AstVisitor* visitor) = 0;
     protected: Value() {} };
 
-  struct ValueModifier {
+  struct ValueModifier : public Node {
     virtual ~ValueModifier() {}
     virtual std::string format() const = 0;
     virtual void accept(AstVisitor* visitor) = 0;
     protected: ValueModifier() {} };
 
-  struct InArgument {
+  struct InArgument : public Node {
     virtual ~InArgument() {}
     virtual std::string format() const = 0;
     protected: InArgument() {} };
 
-  struct OutArgument {
+  struct OutArgument : public Node {
     virtual ~OutArgument() {}
     virtual std::string format() const = 0;
     protected: OutArgument() {} };
 
-  struct Term {
+  struct Term : public Node {
     Term(const std::vector<PTR<ValueModifier> >& headers_,
         PTR<Value> value_, const std::vector<PTR<ValueModifier> >& trailers_);
     PTR<Value> value;
@@ -81,7 +85,7 @@ namespace ast {
     std::string format() const;
   };
 
-  struct Assignee {
+  struct Assignee : public Node {
     Assignee(PTR<Term> term_) : term(term_) {}
     PTR<Term> term;
     std::string format() const;
@@ -0,0 +1,56 @@
+#include "common.h"
+#include "parser.h"
+#include "wrap.h"
+#include "ir.h"
+#include "cps.h"
+#include "optimize.h"
+#include "serialize.h"
+#include <iostream>
+
+using namespace pants;
+
+// builds the precompiled prelude that main.cpp splices user programs into.
+// run by generate_assets.py; prelude source comes in stdin, the cps image
+// comes out stdout.
+int main(int argc, char** argv) {
+
+  if(argc > 1) {
+    std::cout << "usage: " << argv[0] << std::endl;
+    std::cout << "  prelude comes in stdin, cps image comes out stdout"
+              << std::endl;
+    return argc == 2 && argv[1] == std::string("--help") ? 0 : 1;
+  }
+
+  std::string str;
+  std::ostringstream os;
+  while(getline(std::cin, str)) {
+    os << str << '\n';
+  }
+
+  try {
+    std::vector<PTR<ast::Expression> > ast;
+    bool r = parser::parse(os.str(), ast);
+    if(!r) throw expectation_failure("failed parsing!");
+
+    std::vector<PTR<ir::Expression> > ir;
+    wrap::ir_prepend(ir);
+    ir::Name lastval(NULL_VALUE);
+    unsigned long long varcount = 0;
+    ir::convert(ast, ir, lastval, varcount);
+    lastval = NULL_VALUE;
+    ast.clear();
+    std::set<std::string> defined;
+    optimize::ir(ir, &defined, false, varcount);
+
+    PTR<cps::Expression> cps;
+    cps::transform(ir, lastval, cps);
+    ir.clear();
+
+    serialize::write_cps(cps, varcount, std::cout);
+  } catch (const std::exception& e) {
+    std::cerr << "failure: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+#include "server.h"
+#include <csignal>
+
+using namespace pants;
+
+// stands in for pants, handing the compile to a pants --serve instead.
+int main(int argc, char** argv) {
+  std::string socket(server::default_socket());
+  std::vector<std::string> args;
+  for(int i = 1; i < argc; ++i) {
+    if(std::string(argv[i]).find("--socket=") == 0) {
+      socket = std::string(argv[i]).substr(9);
+      continue;
+    }
+    args.push_back(argv[i]);
+  }
+
+  // a server going away mid-request should be an error, not a signal.
+  signal(SIGPIPE, SIG_IGN);
+  try {
+    return server::request(socket, args, std::cin, std::cout, std::cerr);
+  } catch (const std::exception& e) {
+    std::cerr << "failure: " << e.what() << std::endl;
+    return 1;
+  }
+}
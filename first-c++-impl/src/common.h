@@ -7,12 +7,12 @@
 #include <sstream>
 #include <set>
 #include <map>
-#include <boost/shared_ptr.hpp>
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <stdexcept>
+#include "arena.h"
 
-#define PTR boost::shared_ptr
+#define PTR ::pants::Ptr
 
 namespace pants {
 
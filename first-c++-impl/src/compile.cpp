@@ -1,6 +1,8 @@
 #include "compile.h"
 #include "assets.h"
 #include "wrap.h"
+#include <boost/thread.hpp>
+#include <cstdio>
 
 using namespace pants::cps;
 using namespace pants::annotate;
@@ -8,41 +10,235 @@ using namespace pants::annotate;
 #define MIN_RIGHT_ARG_HIGHWATER 10
 #define MIN_LEFT_ARG_HIGHWATER 10
 
-class VariableContext {
+static const std::string DEST("dest");
+
+// how a variable annotate::types could pin down is kept: just its number,
+// rather than a whole union Value.
+struct RawType {
+  const char* member;
+  const char* tag;
+  const char* type;
+  const char* c_type;
+};
+
+static const RawType RAW_INTEGER = {"integer", "INTEGER", "Integer",
+    "long long"};
+static const RawType RAW_FLOAT = {"floating", "FLOAT", "Float", "double"};
+
+static const RawType* raw_type(DataStore::Type type) {
+  if(type == DataStore::INTEGER) return &RAW_INTEGER;
+  if(type == DataStore::FLOAT) return &RAW_FLOAT;
+  return NULL;
+}
+
+// something generated code can refer to a value by: a variable, reached
+// through one of a context's prefixes (and through its cell if it's
+// boxed), or some literal text. a variable kept as a raw number reads as a
+// union Value made up on the spot, and gets written through Slot and Unwrap.
+struct Reference {
+  Reference(const std::string& text_)
+    : prefix(NULL), text(&text_), cell(false), raw(NULL) {}
+  Reference(const std::string& prefix_, const std::string& text_, bool cell_,
+      const RawType* raw_)
+    : prefix(&prefix_), text(&text_), cell(cell_), raw(raw_) {}
+  const std::string* prefix;
+  const std::string* text;
+  bool cell;
+  const RawType* raw;
+};
+
+// where a reference's value is actually kept, raw or not.
+struct Slot {
+  explicit Slot(const Reference& ref_) : ref(ref_) {}
+  const Reference& ref;
+};
+
+// follows a union Value being stored into ref down to the number, if ref is
+// kept raw.
+struct Unwrap {
+  explicit Unwrap(const Reference& ref_) : ref(ref_) {}
+  const Reference& ref;
+};
+
+// a reference's number, for when it's known to be of type raw.
+struct Number {
+  Number(const Reference& ref_, const RawType& raw_) : ref(ref_), raw(raw_) {}
+  const Reference& ref;
+  const RawType& raw;
+};
+
+// a string as a C string literal, every byte escaped.
+struct ByteString {
+  explicit ByteString(const std::string& data_) : data(data_) {}
+  const std::string& data;
+};
+
+static inline ByteString to_bytestring(const std::string& data) {
+  return ByteString(data);
+}
+
+// generated code is appended here rather than formatted through an
+// ostream, and only gets written out in large pieces.
+class Output : boost::noncopyable {
 public:
-  VariableContext(unsigned int free_id, unsigned int frame_id)
-    : m_freeID(free_id), m_frameID(frame_id) {}
-  VariableContext(unsigned int free_id, unsigned int frame_id,
-      const std::set<Name>& active_frame_names)
-    : m_freeID(free_id), m_frameID(frame_id),
-      m_activeFrameNames(active_frame_names) {}
-  std::string varAccess(const Name& name) {
-    std::ostringstream os;
-    os << "((struct nameset_";
-    if(m_activeFrameNames.find(name) != m_activeFrameNames.end()) {
-      os << m_frameID << "*)frame)->";
-    } else {
-      os << m_freeID << "*)env)->";
+  Output& operator<<(const char* text) { m_data.append(text); return *this; }
+  Output& operator<<(const std::string& text) {
+    m_data.append(text);
+    return *this;
+  }
+  Output& operator<<(int value) { return *this << (long long)value; }
+  Output& operator<<(long value) { return *this << (long long)value; }
+  Output& operator<<(unsigned int value)
+    { return *this << (unsigned long long)value; }
+  Output& operator<<(unsigned long value)
+    { return *this << (unsigned long long)value; }
+  Output& operator<<(long long value) {
+    if(value >= 0) return *this << (unsigned long long)value;
+    m_data.push_back('-');
+    return *this << (unsigned long long)(-(value + 1)) + 1;
+  }
+  Output& operator<<(unsigned long long value) {
+    char buffer[20];
+    char* pos = buffer + sizeof(buffer);
+    do {
+      *--pos = '0' + value % 10;
+      value /= 10;
+    } while(value);
+    m_data.append(pos, buffer + sizeof(buffer) - pos);
+    return *this;
+  }
+  // enough digits that the C compiler reads back the very same double.
+  Output& operator<<(double value) {
+    char buffer[32];
+    m_data.append(buffer, snprintf(buffer, sizeof(buffer), "%.17g", value));
+    return *this;
+  }
+  Output& operator<<(const Reference& ref) {
+    if(ref.raw) {
+      return *this << "((union Value){." << ref.raw->member << " = (struct "
+                   << ref.raw->type << "){" << ref.raw->tag << ", "
+                   << Slot(ref) << "}})";
     }
-    os << name.c_name();
-    return os.str();
+    return *this << Slot(ref);
   }
-  std::string valAccess(const Name& name, bool is_mutated) {
-    if(is_mutated) {
-      std::ostringstream os;
-      os << "(*" << varAccess(name) << ".cell.addr)";
-      return os.str();
-    } else {
-      return varAccess(name);
+  Output& operator<<(const Slot& slot) {
+    if(slot.ref.cell) m_data.append("(*");
+    if(slot.ref.prefix) m_data.append(*slot.ref.prefix);
+    m_data.append(*slot.ref.text);
+    if(slot.ref.cell) m_data.append(".cell.addr)");
+    return *this;
+  }
+  Output& operator<<(const Unwrap& unwrap) {
+    if(unwrap.ref.raw)
+      *this << "." << unwrap.ref.raw->member << ".value";
+    return *this;
+  }
+  Output& operator<<(const Number& number) {
+    if(number.ref.raw == &number.raw) return *this << Slot(number.ref);
+    return *this << number.ref << "." << number.raw.member << ".value";
+  }
+  // bytes are escaped the way an ostream in hex mode prints them as ints.
+  Output& operator<<(const ByteString& str) {
+    static const char digits[] = "0123456789abcdef";
+    m_data.push_back('"');
+    for(unsigned int i = 0; i < str.data.size(); ++i) {
+      unsigned int value = (int)str.data[i];
+      char buffer[8];
+      char* pos = buffer + sizeof(buffer);
+      do {
+        *--pos = digits[value & 0xf];
+        value >>= 4;
+      } while(value);
+      m_data.append("\\x");
+      m_data.append(pos, buffer + sizeof(buffer) - pos);
     }
+    m_data.append("\\x00\"");
+    return *this;
+  }
+  std::string& str() { return m_data; }
+  void write(std::ostream& os) const
+    { os.write(m_data.data(), m_data.size()); }
+private:
+  std::string m_data;
+};
+
+// a while loop written in place: where a break called right in its body
+// goes, where a continue does, and the slot the body's dynamic variables
+// are kept in.
+struct Loop {
+  Loop(const std::string& done_, const std::string& test_,
+      const Name& dynamic_vars_)
+    : done(done_), test(test_), dynamic_vars(dynamic_vars_) {}
+  std::string done;
+  std::string test;
+  Name dynamic_vars;
+};
+
+class VariableContext {
+public:
+  VariableContext(unsigned int free_id, unsigned int frame_id,
+      bool pooled_frame, const std::string& name, const DataStore* store)
+    : m_freeID(free_id), m_frameID(frame_id), m_pooledFrame(pooled_frame),
+      m_name(name), m_labels(0), m_loop(NULL), m_store(store)
+    { setPrefixes(); }
+  VariableContext(unsigned int free_id, unsigned int frame_id,
+      const std::set<Name>& active_frame_names, const std::string& name,
+      const DataStore* store)
+    : m_freeID(free_id), m_frameID(frame_id), m_pooledFrame(false),
+      m_activeFrameNames(active_frame_names), m_name(name), m_labels(0),
+      m_loop(NULL), m_store(store) { setPrefixes(); }
+  Reference varAccess(const Name& name) const {
+    return valAccess(name, false);
+  }
+  Reference valAccess(const Name& name, bool is_boxed) const {
+    if(m_loop && name == DYNAMIC_VARS)
+      return valAccess(m_loop->dynamic_vars, false);
+    const RawType* raw(raw_type(m_store->rawType(name)));
+    if(m_activeFrameNames.find(name) != m_activeFrameNames.end())
+      return Reference(m_framePrefix, name.c_name(), is_boxed, raw);
+    return Reference(m_freePrefix, name.c_name(), is_boxed, raw);
   }
   void localDefinition(const Name& name) { m_activeFrameNames.insert(name); }
   unsigned int frameID() { return m_frameID; }
   unsigned int freeID() { return m_freeID; }
+  // whether the frame goes back on frame_pool_<frameID> on return.
+  bool pooledFrame() const { return m_pooledFrame; }
+  // a label no other code in the program uses, for code written in place.
+  std::string newLabel(const char* what) {
+    Output label;
+    label << m_name << "_" << what << "_" << m_labels++;
+    return label.str();
+  }
+  // the label returning goes to while writing the branches of an if that
+  // has a continuation of its own, or of a while, instead of the function's
+  // continuation. empty otherwise.
+  const std::string& returnsTo() const { return m_returnsTo; }
+  void setReturnsTo(const std::string& label) { m_returnsTo = label; }
+  // the innermost loop written in place whose body is being written, if
+  // any. the body runs with dynamic variables of its own.
+  const Loop* loop() const { return m_loop; }
+  void setLoop(const Loop* loop) { m_loop = loop; }
+private:
+  // every variable access starts with one of these.
+  void setPrefixes() {
+    Output frame, free;
+    frame << "((struct nameset_" << m_frameID << "*)frame)->";
+    free << "((struct nameset_" << m_freeID << "*)env)->";
+    m_framePrefix.swap(frame.str());
+    m_freePrefix.swap(free.str());
+  }
 private:
   unsigned int m_freeID;
   unsigned int m_frameID;
+  bool m_pooledFrame;
   std::set<Name> m_activeFrameNames;
+  std::string m_name;
+  unsigned int m_labels;
+  std::string m_returnsTo;
+  const Loop* m_loop;
+  const DataStore* m_store;
+  std::string m_framePrefix;
+  std::string m_freePrefix;
 };
 
 class NameSetManager {
@@ -50,38 +246,48 @@ public:
   typedef std::map<std::string, std::pair<std::set<Name>, unsigned int> >
           NameSetContainer;
 public:
-  void addSet(const std::set<Name>& names) { getID(names); }
-
-  unsigned int getID(const std::set<Name>& names) {
+  // every set has to be added before code generation starts. after that
+  // the manager is only read, so callables can share it across threads.
+  void addSet(const std::set<Name>& names) {
     std::string key(namesetKey(names));
-    NameSetContainer::iterator it(m_namesets.find(key));
-    if(it != m_namesets.end()) return it->second.second;
+    if(m_namesets.find(key) != m_namesets.end()) return;
     m_namesets[key].first = names;
     m_namesets[key].second = m_namesets.size();
-    return m_namesets.size();
   }
 
-  void writeStructs(std::ostream& os) {
-    for(NameSetContainer::iterator it1(m_namesets.begin());
+  unsigned int getID(const std::set<Name>& names) const {
+    NameSetContainer::const_iterator it(m_namesets.find(namesetKey(names)));
+    if(it == m_namesets.end())
+      throw pants::expectation_failure("unknown nameset");
+    return it->second.second;
+  }
+
+  unsigned int size() const { return m_namesets.size(); }
+
+  void writeStructs(Output& os, const DataStore& store) const {
+    for(NameSetContainer::const_iterator it1(m_namesets.begin());
         it1 != m_namesets.end(); ++it1) {
       os << "struct nameset_" << it1->second.second << " {\n";
-      for(std::set<Name>::iterator it2(it1->second.first.begin());
+      for(std::set<Name>::const_iterator it2(it1->second.first.begin());
           it2 != it1->second.first.end(); ++it2) {
-        os << "  union Value " << it2->c_name() << ";\n";
+        const RawType* raw(raw_type(store.rawType(*it2)));
+        os << "  " << (raw ? raw->c_type : "union Value") << " "
+           << it2->c_name() << ";\n";
       }
       os << "};\n\n";
     }
   }
 
 private:
-  std::string namesetKey(const std::set<Name>& names) {
-    std::ostringstream os;
+  std::string namesetKey(const std::set<Name>& names) const {
+    std::string key;
     for(std::set<Name>::const_iterator it(names.begin()); it != names.end();
         ++it) {
       // yay sets being in sorted order always
-      os << it->c_name() << ", ";
+      key.append(it->c_name());
+      key.append(", ");
     }
-    return os.str();
+    return key;
   }
 
 private:
@@ -89,25 +295,18 @@ private:
 
 };
 
-static std::string to_bytestring(const std::string& data) {
-  std::ostringstream os;
-  os << "\"" << std::hex;
-  for(unsigned int i = 0; i < data.size(); ++i) os << "\\x" << (int)data[i];
-  os << "\\x00\"";
-  return os.str();
-}
-
-static void inline write_expression(PTR<Expression> cps, std::ostream& os,
+static void inline write_expression(PTR<Expression> cps, Output& os,
     VariableContext& context, NameSetManager& namesets, DataStore& store);
 
 class ValueWriter : public ValueVisitor {
   public:
-    ValueWriter(std::ostream* os, VariableContext* context,
+    ValueWriter(Output* os, VariableContext* context,
         NameSetManager* namesets, DataStore* store)
-      : m_os(os), m_context(context), m_namesets(namesets), m_store(store) {}
+      : m_os(os), m_context(context), m_namesets(namesets), m_lastval(DEST),
+        m_store(store) {}
     void visit(Field* field) {
       *m_os << "  dest = " << m_context->valAccess(field->object->name,
-          m_store->isMutated(field->object->getVarid())) << ";\n"
+          m_store->isBoxed(field->object->getVarid())) << ";\n"
                "  switch(dest.t) {\n"
                "    default:\n"
                "      THROW_ERROR("
@@ -124,17 +323,18 @@ class ValueWriter : public ValueVisitor {
                "      }\n"
                "      break;\n"
                "  }\n";
-      m_lastval = "dest";
+      m_lastval = Reference(DEST);
     }
     void visit(VariableValue* var) {
       m_lastval = m_context->valAccess(var->variable->name,
-          m_store->isMutated(var->variable->getVarid()));
+          m_store->isBoxed(var->variable->getVarid()));
     }
     void visit(Integer* integer) {
-      std::ostringstream os;
+      Output os;
       os << "(union Value){.integer = (struct Integer){INTEGER, "
          << integer->value << "}}";
-      m_lastval = os.str();
+      m_literal.swap(os.str());
+      m_lastval = Reference(m_literal);
     }
     void visit(String* str) {
       *m_os << "  dest.t = STRING;\n"
@@ -143,76 +343,64 @@ class ValueWriter : public ValueVisitor {
                "  dest.string.value.data = " << to_bytestring(str->value)
             << ";\n"
                "  dest.string.value.size = " << str->value.size() << ";\n";
-      m_lastval = "dest";
+      m_lastval = Reference(DEST);
     }
     void visit(Float* floating) {
-      std::ostringstream os;
+      Output os;
       os << "(union Value){.floating = (struct Float){FLOAT, "
          << floating->value << "}}";
-      m_lastval = os.str();
+      m_literal.swap(os.str());
+      m_lastval = Reference(m_literal);
     }
     void visit(Callable* func) {
-      std::set<Name> free_names;
-      func->free_names(free_names);
-      unsigned int free_id(m_namesets->getID(free_names));
       *m_os << "  dest.t = CLOSURE;\n"
                "  dest.closure.func = &&" << func->c_name() << ";\n";
       if(func->function) {
-        *m_os << "  dest.closure.frame = NULL;\n"
-                 "  dest.closure.env = GC_MALLOC(sizeof(struct nameset_"
+        *m_os << "  dest.closure.frame = NULL;\n";
+        writeEnvironment(func);
+      } else {
+        *m_os << "  dest.closure.frame = frame;\n"
+                 "  dest.closure.env = env;\n";
+      }
+      m_lastval = Reference(DEST);
+    }
+    Reference lastval() const { return m_lastval; }
+  private:
+    void writeEnvironment(Callable* func) {
+      const std::set<Name>& free_names(func->getFreeNames());
+      if(func->environment == Callable::SHARED_ENV) {
+        *m_os << "  dest.closure.env = env;\n";
+      } else if(func->environment == Callable::SHARED_FRAME) {
+        *m_os << "  dest.closure.env = frame;\n";
+      } else if(free_names.empty()) {
+        *m_os << "  dest.closure.env = NULL;\n";
+      } else {
+        unsigned int free_id(m_namesets->getID(free_names));
+        *m_os << "  dest.closure.env = GC_MALLOC(sizeof(struct nameset_"
               << free_id << "));\n";
         for(std::set<Name>::const_iterator it(free_names.begin());
             it != free_names.end(); ++it) {
           *m_os << "  ((struct nameset_" << free_id << "*)dest.closure.env)->"
-                << it->c_name() << " = " << m_context->varAccess(*it) << ";\n";
+                << it->c_name() << " = " << Slot(m_context->varAccess(*it))
+                << ";\n";
         }
-      } else {
-        *m_os << "  dest.closure.frame = frame;\n"
-                 "  dest.closure.env = env;\n";
       }
-      m_lastval = "dest";
     }
-    std::string lastval() const { return m_lastval; }
   private:
-    std::ostream* m_os;
+    Output* m_os;
     VariableContext* m_context;
     NameSetManager* m_namesets;
-    std::string m_lastval;
+    std::string m_literal;
+    Reference m_lastval;
     DataStore* m_store;
 };
 
-static void write_callable(std::ostream& os, Callable* func,
-    VariableContext* context, NameSetManager* namesets, DataStore* store) {
-  // TODO: don't generate code we know we don't need!
-  //   * don't deal with keyword arguments if none are passed in
-  //   * don't require slot checking for arguments with default values.
-
-  // set up callable's address
-  os << "\n" << func->c_name() << ":\n";
-  if(func->function) {
-    // if it's actually a function, we want to save off the current
-    // continuation, dynamic vars, and make a frame
-    context->localDefinition(CONTINUATION);
-    context->localDefinition(DYNAMIC_VARS);
-    os << "  frame = GC_MALLOC(sizeof(struct nameset_" << context->frameID()
-       << "));\n"
-          "  " << context->varAccess(CONTINUATION) << " = continuation;\n"
-          "  " << context->varAccess(DYNAMIC_VARS) << " = dynamic_vars;\n";
-  }
-
-  // were we given a right keyword argument? make space so we can add any
-  // overflow keyword arguments if necessary
-  if(!!func->right_keyword_arg) {
-    bool is_mutated(store->isMutated(func->right_keyword_arg->getVarid()));
-    context->localDefinition(func->right_keyword_arg->name);
-    os << "  make_object(&dest);\n"
-          "  " << context->varAccess(func->right_keyword_arg->name) << " = "
-       << (is_mutated ? "make_cell(dest);\n" : "dest;\n");
-  }
+// the names and positions of all of a function's possible keyword
+// arguments: the slot, and which side it's on, 0 for the left and 1 for the
+// right.
+typedef std::map<Name, std::pair<unsigned int, unsigned int> > ArgumentSlots;
 
-  // alright, go through and find all the names and positions of possible
-  // keyword arguments.
-  std::map<Name, std::pair<unsigned int, unsigned int> > argument_slots;
+static void find_argument_slots(Callable* func, ArgumentSlots& argument_slots) {
   for(unsigned int i = 0; i < func->right_positional_args.size(); ++i) {
     if(argument_slots.find(func->right_positional_args[i]->name) !=
         argument_slots.end())
@@ -245,6 +433,95 @@ static void write_callable(std::ostream& os, Callable* func,
         + func->left_positional_args.size();
     argument_slots[func->left_optional_args[i].key->name].second = 0;
   }
+}
+
+// we only handle named arguments if any of the arguments defined in the
+// function are user provided, there are default values, or someone is
+// accepting a keyword object
+static bool handles_named_arguments(Callable* func,
+    const ArgumentSlots& argument_slots) {
+  if((func->left_optional_args.size() + func->right_optional_args.size()) > 0
+      || func->right_keyword_arg)
+    return true;
+  for(ArgumentSlots::const_iterator it(argument_slots.begin());
+      it != argument_slots.end(); ++it) {
+    if(it->first.user_provided()) return true;
+  }
+  return false;
+}
+
+// the same 64 bit fnv-1a hash_key works out at runtime.
+static unsigned long long keyword_hash(const std::string& name) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for(unsigned int i = 0; i < name.size(); ++i) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// picks a multiplier so the top bits of each hash times it land every name
+// in a bucket of its own, and returns how many bits that took. if nothing
+// turns up after a few extra bits, some names just end up sharing.
+static unsigned int perfect_hash(const std::vector<unsigned long long>& hashes,
+    unsigned long long& multiplier) {
+  unsigned int min_bits = 1;
+  while((1ULL << min_bits) < hashes.size()) ++min_bits;
+  unsigned long long state = 0;
+  for(unsigned int bits = min_bits; ; ++bits) {
+    for(unsigned int tries = 0; tries < 256; ++tries) {
+      // splitmix64, just for a deterministic run of odd multipliers.
+      unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      multiplier = (z ^ (z >> 31)) | 1;
+      std::set<unsigned long long> buckets;
+      for(unsigned int i = 0; i < hashes.size(); ++i)
+        buckets.insert((hashes[i] * multiplier) >> (64 - bits));
+      if(buckets.size() == hashes.size() || bits == min_bits + 3)
+        return bits;
+    }
+  }
+}
+
+static void write_callable(Output& os, Callable* func,
+    VariableContext* context, NameSetManager* namesets, DataStore* store) {
+  // TODO: don't generate code we know we don't need!
+  //   * don't deal with keyword arguments if none are passed in
+  //   * don't require slot checking for arguments with default values.
+
+  // set up callable's address
+  os << "\n" << func->c_name() << ":\n";
+  if(func->function) {
+    // if it's actually a function, we want to save off the current
+    // continuation, dynamic vars, and make a frame
+    context->localDefinition(CONTINUATION);
+    context->localDefinition(DYNAMIC_VARS);
+    if(context->pooledFrame()) {
+      os << "  POP_FRAME(frame_pool_" << context->frameID()
+         << ", sizeof(struct nameset_" << context->frameID() << "))\n";
+    } else {
+      os << "  frame = GC_MALLOC(sizeof(struct nameset_" << context->frameID()
+         << "));\n";
+    }
+    os << "  " << context->varAccess(CONTINUATION) << " = continuation;\n"
+          "  " << context->varAccess(DYNAMIC_VARS) << " = dynamic_vars;\n";
+  }
+
+  // were we given a right keyword argument? make space so we can add any
+  // overflow keyword arguments if necessary
+  if(!!func->right_keyword_arg) {
+    bool is_boxed(store->isBoxed(func->right_keyword_arg->getVarid()));
+    context->localDefinition(func->right_keyword_arg->name);
+    os << "  make_object(&dest);\n"
+          "  " << context->varAccess(func->right_keyword_arg->name) << " = "
+       << (is_boxed ? "make_cell(dest);\n" : "dest;\n");
+  }
+
+  // alright, go through and find all the names and positions of possible
+  // keyword arguments.
+  ArgumentSlots argument_slots;
+  find_argument_slots(func, argument_slots);
   unsigned int right_argument_slots =
       func->right_positional_args.size() + func->right_optional_args.size();
   unsigned int left_argument_slots =
@@ -257,30 +534,21 @@ static void write_callable(std::ostream& os, Callable* func,
   if(left_argument_slots >= 64)
     throw pants::expectation_failure("too many left arguments");
 
-  // we only handle named arguments if any of the arguments defined in the
-  // function are user provided, there are default values, or someone is
-  // accepting a keyword object
-  bool handle_named_arguments = (func->left_optional_args.size() +
-      func->right_optional_args.size()) > 0 || func->right_keyword_arg;
-  if(!handle_named_arguments) {
-    for(std::map<Name, std::pair<unsigned int, unsigned int> >::iterator it(
-        argument_slots.begin()); it != argument_slots.end(); ++it) {
-      if(it->first.user_provided) {
-        handle_named_arguments = true;
-        break;
-      }
-    }
-  }
+  bool handle_named_arguments(handles_named_arguments(func,
+      argument_slots));
 
   if(handle_named_arguments) {
-    // if we have any possible named arguments, let's deal with them
+    // if we have any possible named arguments, let's deal with them. a caller
+    // that knew where its named arguments go has already put them there and
+    // marked them in named_slots, which is otherwise left empty between
+    // calls.
     if(right_argument_slots > 0) {
       os << "  if(right_positional_args.size > " << right_argument_slots
          << ") {\n"
-            "    named_slots[1] = " << ((1 << right_argument_slots) - 1)
+            "    named_slots[1] |= " << ((1 << right_argument_slots) - 1)
          << ";\n"
             "  } else {\n"
-            "    named_slots[1] = (1 << right_positional_args.size) - 1;\n"
+            "    named_slots[1] |= (1 << right_positional_args.size) - 1;\n"
             "  }\n";
   //   It's the caller's responsibility to make sure there's enough space for all
   //   the right argument slots (named arguments can be assumed by the caller to
@@ -291,82 +559,79 @@ static void write_callable(std::ostream& os, Callable* func,
     if(left_argument_slots > 0) {
       os << "  if(left_positional_args.size > " << left_argument_slots
          << ") {\n"
-            "    named_slots[0] = " << ((1 << left_argument_slots) - 1)
+            "    named_slots[0] |= " << ((1 << left_argument_slots) - 1)
          << ";\n"
             "  } else {\n"
-            "    named_slots[0] = (1 << left_positional_args.size) - 1;\n"
+            "    named_slots[0] |= (1 << left_positional_args.size) - 1;\n"
             "  }\n"
             "  reserve_space(&left_positional_args, " << left_argument_slots
          << ");\n";
     }
-    os << "  for(initialize_object_iterator(&it, &keyword_args);\n"
-          "      !object_iterator_complete(&it);\n"
-          "      object_iterator_step(&it)) {\n"
-          "    j = " << argument_slots.size() << ";\n"
-          "    i = binary_search(object_iterator_current_node(&it)->key,\n"
-          "        (struct ByteArray[]){";
-    for(std::map<Name, std::pair<unsigned int, unsigned int> >::iterator it(
-        argument_slots.begin()); it != argument_slots.end();
-        ++it) {
-      if(it != argument_slots.begin()) os << ", ";
-      os << "(struct ByteArray){" << to_bytestring(it->first.c_name())
-         << ", " << it->first.c_name().size() << "}";
-    }
-    os << "}, " << argument_slots.size() << ");\n"
-          "    switch(i) {\n"
-          "      default: break;\n";
-    {
-      unsigned int i = 0;
-      for(std::map<Name, std::pair<unsigned int, unsigned int> >::iterator it(
-          argument_slots.begin()); it != argument_slots.end();
-          ++it, ++i) {
-        os << "      case " << i << ": j = " << it->second.first << "; "
-              "i = " << it->second.second << "; break;\n";
+    // each keyword argument finds its slot through a switch over a perfect
+    // hash of this function's argument names, and one comparison to make
+    // sure.
+    os << "  for(i = 0; i < keyword_args.size; ++i) {\n";
+    if(!argument_slots.empty()) {
+      std::vector<unsigned long long> hashes;
+      for(ArgumentSlots::iterator it(argument_slots.begin());
+          it != argument_slots.end(); ++it)
+        hashes.push_back(keyword_hash(it->first.c_name()));
+      unsigned long long multiplier;
+      unsigned int bits(perfect_hash(hashes, multiplier));
+      std::map<unsigned long long, std::vector<unsigned int> > buckets;
+      for(unsigned int i = 0; i < hashes.size(); ++i)
+        buckets[(hashes[i] * multiplier) >> (64 - bits)].push_back(i);
+      std::vector<ArgumentSlots::iterator> slots;
+      for(ArgumentSlots::iterator it(argument_slots.begin());
+          it != argument_slots.end(); ++it)
+        slots.push_back(it);
+      os << "    switch((unsigned int)((keyword_args.data[i].hash * "
+         << multiplier << "ULL) >> " << 64 - bits << ")) {\n";
+      for(std::map<unsigned long long, std::vector<unsigned int> >::iterator
+          bucket(buckets.begin()); bucket != buckets.end(); ++bucket) {
+        os << "      case " << bucket->first << ":\n";
+        for(unsigned int k = 0; k < bucket->second.size(); ++k) {
+          unsigned int n(bucket->second[k]);
+          const std::string& name(slots[n]->first.c_name());
+          unsigned int slot(slots[n]->second.first);
+          const char* side(slots[n]->second.second == 0 ?
+              "left_positional_args" : "right_positional_args");
+          os << "        if(keyword_args.data[i].hash == " << hashes[n]
+             << "ULL &&\n"
+                "            safe_strcmp(keyword_args.data[i].key, "
+                "(struct ByteArray){" << to_bytestring(name) << ", "
+             << name.size() << "}) == 0) {\n"
+                "          if(" << side << ".size > " << slot << ") {\n"
+                "            THROW_ERROR("
+             << context->valAccess(DYNAMIC_VARS, false) <<
+                ", make_c_string(\"argument %s already provided!\", "
+                "keyword_args.data[i].key.data));\n"
+                "          }\n"
+                "          " << side << ".data[" << slot << "] = "
+                "keyword_args.data[i].value;\n"
+                "          named_slots[" << slots[n]->second.second
+             << "] |= (1 << " << slot << ");\n"
+                "          continue;\n"
+                "        }\n";
+        }
+        os << "        break;\n";
       }
+      os << "    }\n";
     }
-    os << "    }\n"
-          "    if(j == " << argument_slots.size() << ") {\n";
     if(!!func->right_keyword_arg) {
-      os << "      set_field("
+      os << "    set_field("
          << context->valAccess(func->right_keyword_arg->name,
-            store->isMutated(func->right_keyword_arg->getVarid()))
-         << ".object.data, "
-            "object_iterator_current_node(&it)->key, "
-            "object_iterator_current_node(&it)->value);\n"
-            "      continue;\n";
+            store->isBoxed(func->right_keyword_arg->getVarid()))
+         << ".object.data, keyword_args.data[i].key, "
+            "keyword_args.data[i].value);\n";
     } else {
-      os << "      THROW_ERROR("
+      os << "    THROW_ERROR("
          << context->valAccess(DYNAMIC_VARS, false) <<
             ", make_c_string(\"argument %s unknown!\", "
-            "object_iterator_current_node(&it)->key.data));\n";
-    }
-    os << "    }\n"
-          "    if(named_slots[i] & (1 << j)) {\n"
-          "      THROW_ERROR("
-       << context->valAccess(DYNAMIC_VARS, false) <<
-          ", make_c_string(\"argument %s already provided!\", "
-          "object_iterator_current_node(&it)->key.data));\n"
-          "    }\n"
-          "    named_slots[i] |= (1 << j);\n";
-    if(left_argument_slots > 0 && right_argument_slots > 0) {
-      os << "    if(i == 0) {\n"
-            "      left_positional_args.data[j] = "
-            "object_iterator_current_node(&it)->value;\n"
-            "    } else {\n"
-            "      right_positional_args.data[j] = "
-            "object_iterator_current_node(&it)->value;\n"
-            "    }\n";
-    } else {
-      if(left_argument_slots > 0) {
-        os << "    left_positional_args.data[j] = "
-              "object_iterator_current_node(&it)->value;\n";
-      } else {
-        os << "    right_positional_args.data[j] = "
-              "object_iterator_current_node(&it)->value;\n";
-      }
+            "keyword_args.data[i].key.data));\n";
     }
     os << "  }\n"
-          "  initialize_object(&keyword_args);\n";
+          "  keyword_args.size = 0;\n";
 
     // okay, now we have all of the provided and named arguments in slots, let's
     // throw in default values for anything still missing.
@@ -376,7 +641,7 @@ static void write_callable(std::ostream& os, Callable* func,
             "    right_positional_args.data["
          << i + func->right_positional_args.size() << "] = "
          << context->valAccess(func->right_optional_args[i].value->name,
-            store->isMutated(func->right_optional_args[i].value->getVarid()))
+            store->isBoxed(func->right_optional_args[i].value->getVarid()))
          << ";\n"
          << "    named_slots[1] |= (1 << "
          << i + func->right_positional_args.size() << ");\n"
@@ -389,7 +654,7 @@ static void write_callable(std::ostream& os, Callable* func,
          << i + func->left_positional_args.size() << "] = "
          << context->valAccess(func->left_optional_args[
             func->left_optional_args.size() - i - 1].value->name,
-            store->isMutated(func->left_optional_args[
+            store->isBoxed(func->left_optional_args[
             func->left_optional_args.size() - i - 1].value->getVarid())) << ";\n"
          << "    named_slots[0] |= (1 << "
          << i + func->left_positional_args.size() << ");\n"
@@ -399,7 +664,7 @@ static void write_callable(std::ostream& os, Callable* func,
     // let's seal the keyword object
     if(!!func->right_keyword_arg) {
       os << "  seal_object(" << context->valAccess(func->right_keyword_arg->name,
-            store->isMutated(func->right_keyword_arg->getVarid()))
+            store->isBoxed(func->right_keyword_arg->getVarid()))
          << ".object.data);\n";
     }
 
@@ -428,6 +693,8 @@ static void write_callable(std::ostream& os, Callable* func,
          << ";\n"
             "  }\n";
     }
+    if(right_argument_slots > 0) os << "  named_slots[1] = 0;\n";
+    if(left_argument_slots > 0) os << "  named_slots[0] = 0;\n";
   } else {
     // we didn't deal with named objects, so we just have to check if we got
     // everything
@@ -435,71 +702,76 @@ static void write_callable(std::ostream& os, Callable* func,
           "  MIN_RIGHT_ARGS(" << right_argument_slots << ")\n";
   }
 
+  // a self call made with a frame nothing else can see again comes back
+  // here, reusing the frame.
+  if(func->function && func->self_called && context->pooledFrame())
+    os << func->c_name() << "_bind:\n";
+
   // okay, let's actually take our slots and fill in the real arguments
   for(unsigned int i = 0; i < func->right_positional_args.size(); ++i) {
-    bool is_mutated(store->isMutated(
+    bool is_boxed(store->isBoxed(
         func->right_positional_args[i]->getVarid()));
     context->localDefinition(func->right_positional_args[i]->name);
-    os << "  " << context->varAccess(func->right_positional_args[i]->name)
-       << " = ";
-    if(is_mutated) os << "make_cell(";
-    os << "right_positional_args.data[" << i << "]";
-    if(is_mutated) os << ")";
+    Reference slot(context->varAccess(func->right_positional_args[i]->name));
+    os << "  " << Slot(slot) << " = ";
+    if(is_boxed) os << "make_cell(";
+    os << "right_positional_args.data[" << i << "]" << Unwrap(slot);
+    if(is_boxed) os << ")";
     os << ";\n";
   }
   for(unsigned int i = 0; i < func->right_optional_args.size(); ++i) {
-    bool is_mutated(store->isMutated(
+    bool is_boxed(store->isBoxed(
         func->right_optional_args[i].key->getVarid()));
     context->localDefinition(func->right_optional_args[i].key->name);
-    os << "  " << context->varAccess(func->right_optional_args[i].key->name)
-       << " = ";
-    if(is_mutated) os << "make_cell(";
+    Reference slot(context->varAccess(func->right_optional_args[i].key->name));
+    os << "  " << Slot(slot) << " = ";
+    if(is_boxed) os << "make_cell(";
     os << "right_positional_args.data["
-       << i + func->right_positional_args.size() << "]";
-    if(is_mutated) os << ")";
+       << i + func->right_positional_args.size() << "]" << Unwrap(slot);
+    if(is_boxed) os << ")";
     os << ";\n";
   }
   for(unsigned int i = 0; i < func->left_positional_args.size(); ++i) {
-    bool is_mutated(store->isMutated(
+    bool is_boxed(store->isBoxed(
         func->left_positional_args[i]->getVarid()));
     context->localDefinition(func->left_positional_args[i]->name);
-    os << "  " << context->varAccess(func->left_positional_args[i]->name)
-       << " = ";
-    if(is_mutated) os << "make_cell(";
+    Reference slot(context->varAccess(func->left_positional_args[i]->name));
+    os << "  " << Slot(slot) << " = ";
+    if(is_boxed) os << "make_cell(";
     os << "left_positional_args.data["
-       << (func->left_positional_args.size() - i - 1) << "]";
-    if(is_mutated) os << ")";
+       << (func->left_positional_args.size() - i - 1) << "]" << Unwrap(slot);
+    if(is_boxed) os << ")";
     os << ";\n";
   }
   for(unsigned int i = 0; i < func->left_optional_args.size(); ++i) {
-    bool is_mutated(store->isMutated(
+    bool is_boxed(store->isBoxed(
         func->left_optional_args[i].key->getVarid()));
     context->localDefinition(func->left_optional_args[i].key->name);
-    os << "  " << context->varAccess(func->left_optional_args[i].key->name)
-       << " = ";
-    if(is_mutated) os << "make_cell(";
+    Reference slot(context->varAccess(func->left_optional_args[i].key->name));
+    os << "  " << Slot(slot) << " = ";
+    if(is_boxed) os << "make_cell(";
     os << "left_positional_args.data["
        << ((func->left_optional_args.size() - i - 1) +
-           func->left_positional_args.size()) << "]";
-    if(is_mutated) os << ")";
+           func->left_positional_args.size()) << "]" << Unwrap(slot);
+    if(is_boxed) os << ")";
     os << ";\n";
   }
 
   // okay, any overflow arguments go into an array
   if(!!func->right_arbitrary_arg) {
-    bool is_mutated(store->isMutated(func->right_arbitrary_arg->getVarid()));
+    bool is_boxed(store->isBoxed(func->right_arbitrary_arg->getVarid()));
     context->localDefinition(func->right_arbitrary_arg->name);
     os << "  make_array_object(&dest, (struct Array**)&raw_swap);\n"
           "  append_values(raw_swap, right_positional_args.data + "
        << right_argument_slots << ", right_positional_args.size - "
        << right_argument_slots << ");\n"
           "  " << context->varAccess(func->right_arbitrary_arg->name) << " = "
-       << (is_mutated ? "make_cell(dest);\n" : "dest;\n");
+       << (is_boxed ? "make_cell(dest);\n" : "dest;\n");
   } else {
     os << "  MAX_RIGHT_ARGS(" << right_argument_slots << ")\n";
   }
   if(!!func->left_arbitrary_arg) {
-    bool is_mutated(store->isMutated(func->left_arbitrary_arg->getVarid()));
+    bool is_boxed(store->isBoxed(func->left_arbitrary_arg->getVarid()));
     context->localDefinition(func->left_arbitrary_arg->name);
     os << "  make_array_object(&dest, (struct Array**)&raw_swap);\n"
           "  reserve_space(raw_swap, left_positional_args.size - "
@@ -512,7 +784,7 @@ static void write_callable(std::ostream& os, Callable* func,
           "  ((struct Array*)raw_swap)->size = left_positional_args.size - "
        << left_argument_slots << ";\n"
           "  " << context->varAccess(func->left_arbitrary_arg->name) << " = "
-       << (is_mutated ? "make_cell(dest);\n" : "dest;\n");
+       << (is_boxed ? "make_cell(dest);\n" : "dest;\n");
   } else {
     os << "  MAX_LEFT_ARGS(" << left_argument_slots << ")\n";
   }
@@ -521,47 +793,162 @@ static void write_callable(std::ostream& os, Callable* func,
   write_expression(func->expression, os, *context, *namesets, *store);
 }
 
+// the builtins a call can do in place when both sides are integers or both
+// are floats.
+struct InlineOperator {
+  const char* builtin;
+  const char* op;
+  bool comparison;
+};
+
+static const InlineOperator INLINE_OPERATORS[] = {
+  {"add", "+", false},
+  {"subtract", "-", false},
+  {"multiply", "*", false},
+  {"lessthan", "<", true},
+  {"equals", "==", true}};
+
+// a two argument call to one of the above that has somewhere to go after.
+static const InlineOperator* inline_operator(Call* call) {
+  if(call->builtin.empty() || (!call->continuation && !call->tail_call) ||
+      !call->binary())
+    return NULL;
+  for(unsigned int i = 0;
+      i < sizeof(INLINE_OPERATORS) / sizeof(INLINE_OPERATORS[0]); ++i)
+    if(call->builtin == INLINE_OPERATORS[i].builtin)
+      return &INLINE_OPERATORS[i];
+  return NULL;
+}
+
+// a while loop with just a test and a body that has somewhere to go after,
+// or with them written in place.
+static bool in_place_while(Call* call) {
+  if(call->builtin == "while" && !call->branches.empty()) return true;
+  return call->builtin == "while" &&
+      (call->continuation || call->tail_call) &&
+      call->left_positional_args.empty() && !call->left_arbitrary_arg &&
+      call->right_positional_args.size() == 2 &&
+      call->right_optional_args.empty() && !call->right_arbitrary_arg &&
+      !call->right_keyword_arg;
+}
+
 class ExpressionWriter : public ExpressionVisitor {
   public:
-    ExpressionWriter(std::ostream* os, VariableContext* context,
+    ExpressionWriter(Output* os, VariableContext* context,
         NameSetManager* namesets, DataStore* store)
       : m_os(os), m_context(context), m_namesets(namesets), m_store(store) {}
     void visit(Call* call) {
+      if(const InlineOperator* op = inline_operator(call)) {
+        write_inline(call, *op);
+      } else if(in_place_while(call)) {
+        write_while(call);
+      } else if(call->builtin == "break" || call->builtin == "continue") {
+        write_jump(call);
+      } else if(!call->branches.empty()) {
+        write_if(call);
+      } else {
+        write_call(call);
+      }
+      if(call->continuation.get())
+        write_callable(*m_os, call->continuation.get(), m_context, m_namesets,
+            m_store);
+    }
+    void visit(Assignment* assignment) {
       ValueWriter writer(m_os, m_context, m_namesets, m_store);
+      assignment->value->accept(&writer);
+      bool written = false;
+      if(assignment->local) {
+        bool is_boxed(m_store->isBoxed(assignment->assignee->getVarid()));
+        m_context->localDefinition(assignment->assignee->name);
+        if(is_boxed) {
+          *m_os << "  " << m_context->varAccess(assignment->assignee->name)
+                << " = make_cell(" << writer.lastval() << ");\n";
+          written = true;
+        }
+      }
+      Reference to(m_context->valAccess(assignment->assignee->name,
+          m_store->isBoxed(assignment->assignee->getVarid())));
+      VariableValue* var(dynamic_cast<VariableValue*>(
+          assignment->value.get()));
+      if(to.raw && var && var->variable->name == NULL_VALUE) {
+        // a raw variable's declaration is never read, or it wouldn't be raw.
+      } else if(to.raw) {
+        *m_os << "  " << Slot(to) << " = "
+              << Number(writer.lastval(), *to.raw) << ";\n";
+      } else if(!written) {
+        *m_os << "  " << to << " = " << writer.lastval() << ";\n";
+      }
+      assignment->next_expression->accept(this);
+    }
+    void visit(ObjectMutation* mut) {
+      *m_os << "  dest = " << m_context->valAccess(mut->object->name,
+               m_store->isBoxed(mut->object->getVarid())) << ";\n"
+               "  switch(dest.t) {\n"
+               "    default:\n"
+               "      THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS, false)
+            << ", make_c_string(\"not an object!\"));\n"
+               "    case OBJECT:\n"
+               "      if(!set_field(dest.object.data, (struct ByteArray){"
+            << to_bytestring(mut->field.c_name()) << ", "
+            << mut->field.c_name().size() << "}, "
+            << m_context->valAccess(mut->value->name, m_store->isBoxed(
+               mut->value->getVarid())) << ")) {\n"
+               "        THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS,
+               false)
+            << ", make_c_string(\"object %s sealed!\", "
+            << to_bytestring(mut->object->name.c_name()) << "));\n"
+               "      }\n"
+               "      break;\n"
+               "  }\n";
+      mut->next_expression->accept(this);
+    }
+  private:
+    void write_call(Call* call) {
+      ValueWriter writer(m_os, m_context, m_namesets, m_store);
+      // the frame already has the continuation and dynamic variables a self
+      // call would hand over.
+      bool reuse_frame(call->self_call && m_context->pooledFrame());
 
       if(call->continuation.get()) {
         call->continuation->accept(&writer);
         *m_os << "  continuation = " << writer.lastval() << ";\n";
-      } else {
+      } else if(call->tail_call && !m_context->returnsTo().empty()) {
+        write_continuation(m_context->returnsTo());
+      } else if(call->tail_call && !reuse_frame) {
+        *m_os << "  continuation = "
+              << m_context->valAccess(CONTINUATION, false) << ";\n";
+      } else if(!call->tail_call) {
         *m_os << "  continuation.t = NIL;\n";
       }
 
+      // named arguments to a function we know can go straight into its
+      // slots, and everything else is handed over as keyword arguments.
+      ArgumentSlots target_slots;
+      bool slotted(slotted_call(call, target_slots));
       if(!!call->right_keyword_arg) {
         *m_os << "  for(initialize_object_iterator(&it, "
               << m_context->valAccess(call->right_keyword_arg->name,
-                 m_store->isMutated(call->right_keyword_arg->getVarid()))
+                 m_store->isBoxed(call->right_keyword_arg->getVarid()))
               << ".object.data);\n"
                  "      !object_iterator_complete(&it);\n"
                  "      object_iterator_step(&it)) {\n"
-                 "    set_field(&keyword_args,\n"
-                 "              object_iterator_current_node(&it)->key,\n"
-                 "              object_iterator_current_node(&it)->value);\n"
+                 "    add_keyword(&keyword_args,\n"
+                 "        object_iterator_current_node(&it)->key,\n"
+                 "        hash_key(object_iterator_current_node(&it)->key),\n"
+                 "        object_iterator_current_node(&it)->value);\n"
                  "  }\n";
       }
-      if(call->right_optional_args.size() > 0) {
-        for(unsigned int i = 0; i < call->right_optional_args.size(); ++i) {
-          *m_os << "  set_field(&keyword_args, (struct ByteArray){"
-                << to_bytestring(
-                    call->right_optional_args[i].key.c_name())
-                << ", "
-                << call->right_optional_args[i].key.c_name().size()
-                << "}, "
-                << m_context->valAccess(
-                    call->right_optional_args[i].value->name,
-                    m_store->isMutated(
-                    call->right_optional_args[i].value->getVarid()))
-                << ");\n";
-        }
+      for(unsigned int i = 0; !slotted && i < call->right_optional_args.size();
+          ++i) {
+        const std::string& name(call->right_optional_args[i].key.c_name());
+        *m_os << "  add_keyword(&keyword_args, (struct ByteArray){"
+              << to_bytestring(name) << ", " << name.size() << "}, "
+              << keyword_hash(name) << "ULL, "
+              << m_context->valAccess(
+                  call->right_optional_args[i].value->name,
+                  m_store->isBoxed(
+                  call->right_optional_args[i].value->getVarid()))
+              << ");\n";
       }
 
       *m_os << "  i = 0;\n";
@@ -571,7 +958,7 @@ class ExpressionWriter : public ExpressionVisitor {
         if(!!call->right_arbitrary_arg) {
           *m_os << "  get_field("
                 << m_context->valAccess(call->right_arbitrary_arg->name,
-                   m_store->isMutated(call->right_arbitrary_arg->getVarid()))
+                   m_store->isBoxed(call->right_arbitrary_arg->getVarid()))
                 << ".object.data, (struct ByteArray){\"u_size\", 6}, &dest);\n";
           *m_os << "  i += ((struct Array*)dest.closure.env)->size;\n";
         }
@@ -586,7 +973,7 @@ class ExpressionWriter : public ExpressionVisitor {
       for(unsigned int i = 0; i < call->right_positional_args.size(); ++i) {
         *m_os << "  right_positional_args.data[" << i << "] = "
               << m_context->valAccess(call->right_positional_args[i]->name,
-                 m_store->isMutated(
+                 m_store->isBoxed(
                  call->right_positional_args[i]->getVarid()))
               << ";\n";
       }
@@ -605,7 +992,7 @@ class ExpressionWriter : public ExpressionVisitor {
         if(!!call->left_arbitrary_arg) {
           *m_os << "  get_field("
                 << m_context->valAccess(call->left_arbitrary_arg->name,
-                   m_store->isMutated(call->left_arbitrary_arg->getVarid()))
+                   m_store->isBoxed(call->left_arbitrary_arg->getVarid()))
                 << ".object.data, (struct ByteArray){\"u_size\", 6}, &dest);\n";
           *m_os << "  i = ((struct Array*)dest.closure.env)->size;\n";
         }
@@ -628,88 +1015,424 @@ class ExpressionWriter : public ExpressionVisitor {
         *m_os << "  left_positional_args.data[" << i << "] = "
               << m_context->valAccess(call->left_positional_args[
                  call->left_positional_args.size() - i - 1]->name,
-                 m_store->isMutated(call->left_positional_args[
+                 m_store->isBoxed(call->left_positional_args[
                  call->left_positional_args.size() - i - 1]->getVarid()))
               << ";\n";
       }
 
-      *m_os << "  dynamic_vars = " << m_context->valAccess(DYNAMIC_VARS, false)
-            << ";\n"
-               "  dest = " << m_context->valAccess(call->callable->name,
-               m_store->isMutated(call->callable->getVarid()))
+      if(slotted) write_slotted(call, target_slots);
+
+      if(!reuse_frame) {
+        *m_os << "  dynamic_vars = "
+              << m_context->valAccess(DYNAMIC_VARS, false) << ";\n";
+      }
+      if(call->target.get()) {
+        // a known function makes its own frame, and only needs the
+        // environment it was made with if it has free names.
+        if(!call->target->getFreeNames().empty()) {
+          *m_os << "  env = " << m_context->valAccess(call->callable->name,
+                   m_store->isBoxed(call->callable->getVarid()))
+                << ".closure.env;\n";
+        }
+        if(reuse_frame) {
+          *m_os << "  goto " << call->target->c_name() << "_bind;\n";
+          return;
+        }
+        write_return(call);
+        *m_os << "  goto " << call->target->c_name() << ";\n";
+      } else if(!m_context->returnsTo().empty() &&
+          call->callable->name == CONTINUATION) {
+        *m_os << "  goto " << m_context->returnsTo() << ";\n";
+      } else {
+        *m_os << "  dest = " << m_context->valAccess(call->callable->name,
+                 m_store->isBoxed(call->callable->getVarid()))
+              << ";\n"
+                 "  if(dest.t != CLOSURE) {\n"
+                 "    THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS, false)
+              << ", make_c_string(\"cannot call a non-function!\"));\n"
+                 "  }\n";
+        write_return(call);
+        *m_os << "  CALL_FUNC(dest)\n";
+      }
+    }
+
+    // whether the function being called is known, takes named arguments,
+    // and has a slot of its own for every one of this call's, and nothing
+    // this call is passing positionally could already be in it.
+    bool slotted_call(Call* call, ArgumentSlots& slots) {
+      if(!call->target || call->right_optional_args.empty() ||
+          !!call->right_keyword_arg || !!call->right_arbitrary_arg ||
+          !!call->left_arbitrary_arg)
+        return false;
+      find_argument_slots(call->target.get(), slots);
+      if(!handles_named_arguments(call->target.get(), slots)) return false;
+      for(unsigned int i = 0; i < call->right_optional_args.size(); ++i) {
+        ArgumentSlots::iterator it(slots.find(call->right_optional_args[i].key));
+        if(it == slots.end()) return false;
+        if(it->second.first < (it->second.second == 0 ?
+            call->left_positional_args.size() :
+            call->right_positional_args.size()))
+          return false;
+      }
+      return true;
+    }
+
+    // writes a slotted call's named arguments where the function would have
+    // put them, and marks them as given.
+    void write_slotted(Call* call, const ArgumentSlots& slots) {
+      Callable* target(call->target.get());
+      unsigned int right_slots(target->right_positional_args.size() +
+          target->right_optional_args.size());
+      unsigned int left_slots(target->left_positional_args.size() +
+          target->left_optional_args.size());
+      if(right_slots > MIN_RIGHT_ARG_HIGHWATER)
+        *m_os << "  reserve_space(&right_positional_args, " << right_slots
+              << ");\n";
+      if(left_slots > MIN_LEFT_ARG_HIGHWATER)
+        *m_os << "  reserve_space(&left_positional_args, " << left_slots
+              << ");\n";
+      unsigned long long named[2] = {0, 0};
+      for(unsigned int i = 0; i < call->right_optional_args.size(); ++i) {
+        const std::pair<unsigned int, unsigned int>& slot(
+            slots.find(call->right_optional_args[i].key)->second);
+        named[slot.second] |= (1ULL << slot.first);
+        *m_os << (slot.second == 0 ? "  left_positional_args.data[" :
+                  "  right_positional_args.data[")
+              << slot.first << "] = "
+              << m_context->valAccess(
+                 call->right_optional_args[i].value->name,
+                 m_store->isBoxed(
+                 call->right_optional_args[i].value->getVarid()))
+              << ";\n";
+      }
+      for(unsigned int i = 0; i < 2; ++i) {
+        if(named[i])
+          *m_os << "  named_slots[" << i << "] = " << named[i] << "ULL;\n";
+      }
+    }
+
+    // a call that leaves the function for good is the last chance to hand
+    // its frame back, once nothing else needs reading out of it.
+    void write_return(Call* call) {
+      if(m_context->pooledFrame() && !call->continuation &&
+          m_context->returnsTo().empty())
+        *m_os << "  PUSH_FRAME(frame_pool_" << m_context->frameID() << ")\n";
+    }
+
+    // hands the result of a tail call written in place on to whatever comes
+    // next.
+    void write_tail_return(Call* call) {
+      if(!m_context->returnsTo().empty()) {
+        *m_os << "  goto " << m_context->returnsTo() << ";\n";
+        return;
+      }
+      *m_os << "  dest = " << m_context->valAccess(CONTINUATION, false)
+            << ";\n";
+      write_return(call);
+      *m_os << "  CALL_FUNC(dest)\n";
+    }
+
+    // the result is left as the only argument, ready for the continuation
+    // (written right after this) or the caller's. any other types go through
+    // the builtin as usual.
+    void write_inline(Call* call, const InlineOperator& op) {
+      const PTR<Variable>& left(call->left_positional_args.empty() ?
+          call->right_positional_args[0] : call->left_positional_args[0]);
+      const PTR<Variable>& right(call->right_positional_args.back());
+      Reference lhs(m_context->valAccess(left->name,
+          m_store->isBoxed(left->getVarid())));
+      Reference rhs(m_context->valAccess(right->name,
+          m_store->isBoxed(right->getVarid())));
+      const RawType* types[2] = {&RAW_INTEGER, &RAW_FLOAT};
+      // annotate::types may already know which one it'll be.
+      DataStore::Type known(m_store->type(left->getVarid()));
+      if(known != m_store->type(right->getVarid()) ||
+          (known != DataStore::INTEGER && known != DataStore::FLOAT))
+        known = DataStore::UNKNOWN;
+      for(unsigned int i = 0; i < 2; ++i) {
+        if(known == DataStore::INTEGER && i != 0) continue;
+        if(known == DataStore::FLOAT && i != 1) continue;
+        if(known == DataStore::UNKNOWN) {
+          *m_os << (i == 0 ? "  if(" : "  } else if(") << lhs << ".t == "
+                << types[i]->tag << " && " << rhs << ".t == " << types[i]->tag
+                << ") {\n";
+        }
+        const char* indent(known == DataStore::UNKNOWN ? "    " : "  ");
+        *m_os << indent << "right_positional_args.data[0]."
+              << (op.comparison ? "boolean" : types[i]->member) << ".value = "
+              << Number(lhs, *types[i]) << " " << op.op << " "
+              << Number(rhs, *types[i]) << ";\n"
+              << indent << "right_positional_args.data[0].t = "
+              << (op.comparison ? "BOOLEAN" : types[i]->tag) << ";\n";
+      }
+      if(known == DataStore::UNKNOWN) {
+        *m_os << "  } else {\n";
+        write_call(call);
+        *m_os << "  }\n";
+      }
+      *m_os << "  left_positional_args.size = 0;\n"
+               "  right_positional_args.size = 1;\n";
+      if(call->tail_call) write_tail_return(call);
+    }
+
+    // what c_while does, but with the loop's labels right here. the loop
+    // goes in env while it runs, and the continuations handed to the test,
+    // the body, and break and continue all come back to this frame.
+    void write_while(Call* call) {
+      if(!call->branches.empty()) {
+        write_loop(call);
+        return;
+      }
+      std::string test(m_context->newLabel("while_test"));
+      std::string tested(m_context->newLabel("while_tested"));
+      std::string next(m_context->newLabel("while_next"));
+      std::string done(m_context->newLabel("while_done"));
+      Reference dynamic_vars(m_context->valAccess(DYNAMIC_VARS, false));
+      for(unsigned int i = 0; i < 2; ++i) {
+        *m_os << "  if(" << m_context->valAccess(
+                 call->right_positional_args[i]->name, m_store->isBoxed(
+                 call->right_positional_args[i]->getVarid()))
+              << ".t != CLOSURE) {\n"
+                 "    THROW_ERROR(" << dynamic_vars
+              << ", make_c_string(\"cannot call a non-function!\"));\n"
+                 "  }\n";
+      }
+      *m_os << "  env = start_while_loop(";
+      for(unsigned int i = 0; i < 2; ++i) {
+        *m_os << m_context->valAccess(call->right_positional_args[i]->name,
+                 m_store->isBoxed(call->right_positional_args[i]->getVarid()))
+              << ",\n      ";
+      }
+      *m_os << dynamic_vars << ", globals.c_while__dynamic__var,\n"
+               "      &&" << next << ", env, frame);\n"
+            << test << ":\n";
+      write_loop_call(tested, "dynamic_vars", "test");
+      *m_os << tested << ":\n"
+               "  dest.t = NIL;\n"
+               "  if(builtin_istrue(&right_positional_args.data[0], "
+               "&dest)) {\n";
+      write_loop_call(test, "body_dynamic_vars", "body");
+      *m_os << "  }\n"
+               "  if(dest.t != NIL) { THROW_ERROR(" << dynamic_vars
+            << ", dest); }\n"
+               "  goto " << done << ";\n"
+            << next << ":\n"
+               "  dest.t = NIL;\n"
+               "  if(builtin_istrue(&right_positional_args.data[0], &dest))\n"
+               "    goto " << test << ";\n"
+               "  if(dest.t != NIL) { THROW_ERROR(" << dynamic_vars
+            << ", dest); }\n"
+            << done << ":\n"
+               "  env = ((struct WhileLoop*)env)->env;\n"
+               "  left_positional_args.size = 0;\n"
+               "  right_positional_args.size = 1;\n"
+               "  right_positional_args.data[0].t = NIL;\n";
+      if(call->tail_call) write_tail_return(call);
+    }
+
+    // calls the loop's test or body, coming back to label.
+    void write_loop_call(const std::string& label, const char* dynamic_vars,
+        const char* callable) {
+      write_continuation(label);
+      *m_os << "  dynamic_vars = ((struct WhileLoop*)env)->" << dynamic_vars
             << ";\n"
-               "  if(dest.t != CLOSURE) {\n"
-               "    THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS, false)
-            << ", make_c_string(\"cannot call a non-function!\"));\n"
-               "  }\n"
+               "  left_positional_args.size = 0;\n"
+               "  right_positional_args.size = 0;\n"
+               "  dest = ((struct WhileLoop*)env)->" << callable << ";\n"
                "  CALL_FUNC(dest)\n";
+    }
 
-      if(call->continuation.get())
-        write_callable(*m_os, call->continuation.get(), m_context, m_namesets,
-            m_store);
+    // a while with its test and body written right here, returning to the
+    // loop's own labels, so nothing leaves the frame or its environment. the
+    // body's dynamic variables are made once, for a break or continue that
+    // isn't called right in it, and those that are just jump.
+    void write_loop(Call* call) {
+      std::string test(m_context->newLabel("while_test"));
+      std::string tested(m_context->newLabel("while_tested"));
+      std::string next(m_context->newLabel("while_next"));
+      std::string stop(m_context->newLabel("while_stop"));
+      std::string done(m_context->newLabel("while_done"));
+      Reference dynamic_vars(m_context->valAccess(DYNAMIC_VARS, false));
+      Loop loop(done, test, call->branches[1]->right_positional_args[0]->name);
+      m_context->localDefinition(loop.dynamic_vars);
+      *m_os << "  " << m_context->varAccess(loop.dynamic_vars)
+            << " = while_body_dynamic_vars(" << dynamic_vars
+            << ",\n      globals.c_while__dynamic__var, &&" << next
+            << ", env, frame);\n"
+            << test << ":\n";
+      write_loop_branch(call, 0, tested, m_context->loop());
+      *m_os << tested << ":\n"
+               "  dest.t = NIL;\n"
+               "  if(!builtin_istrue(&right_positional_args.data[0], &dest))\n"
+               "    goto " << stop << ";\n";
+      write_loop_branch(call, 1, test, &loop);
+      *m_os << next << ":\n"
+               "  dest.t = NIL;\n"
+               "  if(builtin_istrue(&right_positional_args.data[0], &dest))\n"
+               "    goto " << test << ";\n"
+            << stop << ":\n"
+               "  if(dest.t != NIL) { THROW_ERROR(" << dynamic_vars
+            << ", dest); }\n"
+            << done << ":\n"
+               "  left_positional_args.size = 0;\n"
+               "  right_positional_args.size = 1;\n"
+               "  right_positional_args.data[0].t = NIL;\n";
+      if(call->tail_call) write_tail_return(call);
     }
-    void visit(Assignment* assignment) {
-      ValueWriter writer(m_os, m_context, m_namesets, m_store);
-      assignment->value->accept(&writer);
-      bool written = false;
-      if(assignment->local) {
-        bool is_mutated(m_store->isMutated(assignment->assignee->getVarid()));
-        m_context->localDefinition(assignment->assignee->name);
-        if(is_mutated) {
-          *m_os << "  " << m_context->varAccess(assignment->assignee->name)
-                << " = make_cell(" << writer.lastval() << ");\n";
-          written = true;
-        }
+
+    // the test (0) or the body (1), returning to returns_to, with break and
+    // continue called right in it going to loop's labels.
+    void write_loop_branch(Call* call, unsigned int i,
+        const std::string& returns_to, const Loop* loop) {
+      std::string outer_returns_to(m_context->returnsTo());
+      const Loop* outer_loop(m_context->loop());
+      m_context->setReturnsTo(returns_to);
+      m_context->setLoop(loop);
+      write_expression(call->branches[i]->expression, *m_os, *m_context,
+          *m_namesets, *m_store);
+      m_context->setReturnsTo(outer_returns_to);
+      m_context->setLoop(outer_loop);
+    }
+
+    // a break or continue called right in a loop's body.
+    void write_jump(Call* call) {
+      *m_os << "  goto " << (call->builtin == "break" ?
+               m_context->loop()->done : m_context->loop()->test) << ";\n";
+    }
+
+    // a continuation that comes back to label in this frame.
+    void write_continuation(const std::string& label) {
+      *m_os << "  continuation.t = CLOSURE;\n"
+               "  continuation.closure.func = &&" << label << ";\n"
+               "  continuation.closure.env = env;\n"
+               "  continuation.closure.frame = frame;\n";
+    }
+
+    // what c_if does, with the branches written right here. the condition
+    // is only tested for what it is if annotate::types couldn't tell it's a
+    // boolean, and without an else the result is a null.
+    void write_if(Call* call) {
+      const PTR<Variable>& test(call->right_positional_args[0]);
+      Reference value(m_context->valAccess(test->name,
+          m_store->isBoxed(test->getVarid())));
+      bool boolean(m_store->type(test->getVarid()) == DataStore::BOOLEAN);
+      std::string otherwise(m_context->newLabel("if_else"));
+      if(boolean) {
+        *m_os << "  if(!" << value << ".boolean.value) goto " << otherwise
+              << ";\n";
+      } else {
+        *m_os << "  dest.t = NIL;\n"
+                 "  if(!builtin_istrue(&" << value << ", &dest)) goto "
+              << otherwise << ";\n";
       }
-      if(!written) {
-        *m_os << "  " << m_context->valAccess(assignment->assignee->name,
-                 m_store->isMutated(assignment->assignee->getVarid()))
-              << " = " << writer.lastval() << ";\n";
+      write_branch(call, 0);
+      *m_os << otherwise << ":\n";
+      if(!boolean) {
+        *m_os << "  if(dest.t != NIL) { THROW_ERROR("
+              << m_context->valAccess(DYNAMIC_VARS, false) << ", dest); }\n";
       }
-      assignment->next_expression->accept(this);
+      if(call->branches.size() > 1) {
+        write_branch(call, 1);
+        return;
+      }
+      *m_os << "  left_positional_args.size = 0;\n"
+               "  right_positional_args.size = 1;\n"
+               "  right_positional_args.data[0].t = NIL;\n";
+      if(call->tail_call) write_tail_return(call);
     }
-    void visit(ObjectMutation* mut) {
-      *m_os << "  dest = " << m_context->valAccess(mut->object->name,
-               m_store->isMutated(mut->object->getVarid())) << ";\n"
-               "  switch(dest.t) {\n"
-               "    default:\n"
-               "      THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS, false)
-            << ", make_c_string(\"not an object!\"));\n"
-               "    case OBJECT:\n"
-               "      if(!set_field(dest.object.data, (struct ByteArray){"
-            << to_bytestring(mut->field.c_name()) << ", "
-            << mut->field.c_name().size() << "}, "
-            << m_context->valAccess(mut->value->name, m_store->isMutated(
-               mut->value->getVarid())) << ")) {\n"
-               "        THROW_ERROR(" << m_context->valAccess(DYNAMIC_VARS,
-               false)
-            << ", make_c_string(\"object %s sealed!\", "
-            << to_bytestring(mut->object->name.c_name()) << "));\n"
-               "      }\n"
-               "      break;\n"
-               "  }\n";
-      mut->next_expression->accept(this);
+
+    // a branch returns to the if's continuation, which comes right after
+    // the if, or to wherever the if itself would have.
+    void write_branch(Call* call, unsigned int i) {
+      std::string returns_to(m_context->returnsTo());
+      if(call->continuation)
+        m_context->setReturnsTo(call->continuation->c_name());
+      write_expression(call->branches[i]->expression, *m_os, *m_context,
+          *m_namesets, *m_store);
+      m_context->setReturnsTo(returns_to);
     }
-  private:
-    std::ostream* m_os;
+
+    Output* m_os;
     VariableContext* m_context;
     NameSetManager* m_namesets;
     DataStore* m_store;
 };
 
-static void inline write_expression(PTR<Expression> cps, std::ostream& os,
+static void inline write_expression(PTR<Expression> cps, Output& os,
     VariableContext& context, NameSetManager& namesets, DataStore& store) {
   ExpressionWriter writer(&os, &context, &namesets, &store);
   cps->accept(&writer);
 }
 
+// hands the functions out to worker threads one at a time. each function
+// is written into its own buffer, and the buffers are written out in
+// callable order, so the output doesn't depend on the thread count.
+class CallableWriter : boost::noncopyable {
+public:
+  CallableWriter(const std::vector<PTR<Callable> >& callables,
+      NameSetManager* namesets, DataStore* store)
+    : m_callables(callables), m_namesets(namesets), m_store(store),
+      m_next(0), m_output(callables.size()), m_errors(callables.size()) {}
+
+  void run(unsigned int threads) {
+    boost::thread_group workers;
+    for(unsigned int i = 1; i < threads; ++i)
+      workers.create_thread(boost::bind(&CallableWriter::work, this));
+    work();
+    workers.join_all();
+    for(unsigned int i = 0; i < m_errors.size(); ++i) {
+      if(!m_errors[i].empty()) throw pants::expectation_failure(m_errors[i]);
+    }
+  }
+
+  void write(std::ostream& os) const {
+    for(unsigned int i = 0; i < m_output.size(); ++i)
+      os.write(m_output[i].data(), m_output[i].size());
+  }
+
+private:
+  bool next(unsigned int& i) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    while(m_next < m_callables.size() && !m_callables[m_next]->function)
+      ++m_next;
+    if(m_next >= m_callables.size()) return false;
+    i = m_next++;
+    return true;
+  }
+
+  void work() {
+    unsigned int i;
+    while(next(i)) {
+      Callable* func(m_callables[i].get());
+      try {
+        VariableContext context(
+            m_namesets->getID(func->getEnvironmentNames()),
+            m_namesets->getID(func->getFrameNames()), !func->frame_escapes,
+            func->c_name(), m_store);
+        Output os;
+        write_callable(os, func, &context, m_namesets, m_store);
+        m_output[i].swap(os.str());
+      } catch (const std::exception& e) {
+        m_errors[i] = e.what();
+      }
+    }
+  }
+
+private:
+  const std::vector<PTR<Callable> >& m_callables;
+  NameSetManager* m_namesets;
+  DataStore* m_store;
+  boost::mutex m_mutex;
+  unsigned int m_next;
+  std::vector<std::string> m_output;
+  std::vector<std::string> m_errors;
+};
+
 void pants::compile::compile(PTR<Expression> cps, DataStore& store,
-    std::ostream& os, bool use_gc) {
+    std::ostream& os, bool use_gc, unsigned int threads, Statistics* stats) {
 
-  std::vector<PTR<cps::Callable> > callables;
-  std::set<Name> free_names;
-  cps->callables(callables);
-  cps->free_names(free_names);
+  const std::vector<PTR<cps::Callable> >& callables(store.callables());
+  std::set<Name> free_names(store.freeNames());
 
   std::set<Name> provided_names;
   pants::wrap::provided_names(provided_names);
@@ -721,7 +1444,7 @@ void pants::compile::compile(PTR<Expression> cps, DataStore& store,
   if(free_names.size() > 0) {
     std::ostringstream os;
     os << "unbound variable: " << free_names.begin()->format(0);
-    throw expectation_failure(os.str());
+    throw pants::expectation_failure(os.str());
   }
 
   if(use_gc) os << "#define __USE_PANTS_GC\n";
@@ -729,40 +1452,63 @@ void pants::compile::compile(PTR<Expression> cps, DataStore& store,
   os << pants::assets::DATA_STRUCTURES_C << "\n";
   os << pants::assets::BUILTINS_C << "\n";
 
+  // code generation looks names up but never interns new ones, which isn't
+  // thread safe. make sure the ones it builds itself exist already.
+  Name null_value(NULL_VALUE), continuation(CONTINUATION),
+      dynamic_vars(DYNAMIC_VARS);
+
+  if(threads == 0) threads = boost::thread::hardware_concurrency();
+  if(threads == 0) threads = 1;
+
   NameSetManager namesets;
-  std::set<Name> names;
-  // handle globals specially
-  cps->free_names(names);
-  cps->frame_names(names);
+  // handle globals specially. start_main.c sets up every provided name,
+  // whether the program still uses it or not.
+  std::set<Name> names(store.freeNames());
+  names.insert(store.frameNames().begin(), store.frameNames().end());
+  names.insert(provided_names.begin(), provided_names.end());
   namesets.addSet(names);
-  VariableContext root_context(0, namesets.getID(names), provided_names);
+  VariableContext root_context(0, namesets.getID(names), provided_names,
+      "root", &store);
 
   for(unsigned int i = 0; i < callables.size(); ++i) {
     if(!callables[i]->function) continue;
-    names.clear();
-    callables[i]->free_names(names);
-    namesets.addSet(names);
-    names.clear();
-    callables[i]->frame_names(names);
-    namesets.addSet(names);
+    namesets.addSet(callables[i]->getFreeNames());
+    namesets.addSet(callables[i]->getFrameNames());
   }
 
-  namesets.writeStructs(os);
+  Output structs;
+  namesets.writeStructs(structs, store);
+  std::set<unsigned int> pools;
+  for(unsigned int i = 0; i < callables.size(); ++i) {
+    if(callables[i]->function && !callables[i]->frame_escapes &&
+        pools.insert(namesets.getID(callables[i]->getFrameNames())).second)
+      structs << "static void* frame_pool_"
+              << namesets.getID(callables[i]->getFrameNames()) << ";\n";
+  }
+  structs.write(os);
 
   os << pants::assets::START_MAIN_C;
 
-  write_expression(cps, os, root_context, namesets, store);
+  Output body;
+  write_expression(cps, body, root_context, namesets, store);
+  body.write(os);
 
-  for(unsigned int i = 0; i < callables.size(); ++i) {
-    if(callables[i]->function) {
-      std::set<Name> free_names;
-      callables[i]->free_names(free_names);
-      std::set<Name> frame_names;
-      callables[i]->frame_names(frame_names);
-      VariableContext new_context(namesets.getID(free_names),
-          namesets.getID(frame_names));
-      write_callable(os, callables[i].get(), &new_context, &namesets, &store);
-    }
+  CallableWriter writer(callables, &namesets, &store);
+  Name::freeze(true);
+  try {
+    writer.run(threads);
+  } catch(...) {
+    Name::freeze(false);
+    throw;
+  }
+  Name::freeze(false);
+  writer.write(os);
+
+  if(stats) {
+    stats->functions = 0;
+    for(unsigned int i = 0; i < callables.size(); ++i)
+      if(callables[i]->function) ++stats->functions;
+    stats->namesets = namesets.size();
   }
 
   os << pants::assets::END_MAIN_C;
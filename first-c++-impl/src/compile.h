@@ -8,8 +8,18 @@
 namespace pants {
 namespace compile {
 
+  // what compile wrote out, for --time-passes.
+  struct Statistics {
+    Statistics() : functions(0), namesets(0) {}
+    unsigned int functions;
+    unsigned int namesets;
+  };
+
+  // functions are written out on the given number of threads; 0 means one
+  // per core.
   void compile(PTR<cps::Expression> cps, annotate::DataStore& store,
-      std::ostream& os, bool use_gc);
+      std::ostream& os, bool use_gc, unsigned int threads = 0,
+      Statistics* stats = NULL);
 
 }}
 
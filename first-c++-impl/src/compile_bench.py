@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+
+__author__ = "JT Olds <hello@jtolds.com>"
+
+# compiles generated pants programs of growing size, recording the time and
+# memory of each compiler pass (from pants --time-passes=json) plus how long
+# gcc takes on the emitted C, and writes it all to a json report.
+
+import json, os, shutil, subprocess, sys, tempfile, time
+
+WIDE_FUNCTION = (
+    "f_%(i)d = {|a, b: 2; c| d = a +. (b *. c); "
+    "if (d <. 3) { println(d) } { e = [a, b, d]; e[0] := d }; "
+    "{\"x\": d, \"y\": f_%(prev)d}}\n"
+    "f_%(i)d(1; 2, b: 3)\n")
+
+def total(terms):
+  # infix calls don't chain without parentheses.
+  expression = terms[0]
+  for term in terms[1:]:
+    expression = "(%s +. %s)" % (expression, term)
+  return expression
+
+def wide(size):
+  """many top-level definitions."""
+  return "f_0 = null\n" + "".join(WIDE_FUNCTION % {"i": i + 1, "prev": i}
+      for i in xrange(size))
+
+def deep(size):
+  """closures nested inside each other, each using every enclosing arg."""
+  head = []
+  tail = []
+  for i in xrange(size):
+    head.append("g_%d = {|x_%d|\n" % (i, i))
+    tail.append("}\ng_%d(%d)\n" % (i, i))
+  body = total(["x_%d" % i for i in xrange(size)])
+  return "".join(head) + "println(%s)\n" % body + "".join(reversed(tail))
+
+def chain(size):
+  """one long straight-line function body and one long expression."""
+  lines = ["f = {|a|\n", "  v_0 = a\n"]
+  for i in xrange(size):
+    lines.append("  v_%d = v_%d +. %d\n" % (i + 1, i, i))
+  lines.append("  v_%d\n}\n" % size)
+  lines.append("println(%s)\n" % total(["f(1)"] + [str(i) for i in
+      xrange(size)]))
+  return "".join(lines)
+
+SHAPES = [("wide", wide, 25), ("deep", deep, 16), ("chain", chain, 125)]
+
+def run_pants(pants, options, source, c_path):
+  out = open(c_path, "w")
+  start = time.time()
+  proc = subprocess.Popen([pants, "--time-passes=json"] + options,
+      stdin=subprocess.PIPE, stdout=out, stderr=subprocess.PIPE)
+  err = proc.communicate(source)[1]
+  seconds = time.time() - start
+  out.close()
+  if proc.returncode != 0:
+    raise Exception("pants failed: %s" % err.strip())
+  return seconds, json.loads(err)
+
+def run_gcc(c_path):
+  # only compile to an object, so the report doesn't depend on libgc being
+  # around to link against.
+  start = time.time()
+  args = ["gcc", "-c", "-w", "-o", c_path + ".o", c_path]
+  if subprocess.call(args) != 0:
+    raise Exception("gcc failed on %s" % c_path)
+  return time.time() - start
+
+def main(argv):
+  pants = os.path.join(os.path.dirname(os.path.abspath(__file__)), "pants")
+  output = "compile_bench.json"
+  steps = 3
+  options = []
+  for arg in argv[1:]:
+    if arg.startswith("--pants="):
+      pants = arg[len("--pants="):]
+    elif arg.startswith("--output="):
+      output = arg[len("--output="):]
+    elif arg.startswith("--steps="):
+      steps = int(arg[len("--steps="):])
+    elif arg == "--no-gc":
+      options.append(arg)
+    else:
+      sys.stderr.write("usage: %s [--pants=<binary>] [--output=<json file>] "
+          "[--steps=<doublings>] [--no-gc]\n" % argv[0])
+      return arg != "--help"
+
+  tmp = tempfile.mkdtemp(prefix="compile-bench-")
+  results = []
+  try:
+    sys.stdout.write("%-6s %7s %10s %10s %10s %12s\n" % ("shape", "size",
+        "pants s", "gcc s", "c bytes", "peak rss kb"))
+    for name, generate, base in SHAPES:
+      for step in xrange(steps):
+        size = base << step
+        source = generate(size)
+        c_path = os.path.join(tmp, "%s_%d.c" % (name, size))
+        pants_seconds, passes = run_pants(pants, options, source, c_path)
+        gcc_seconds = run_gcc(c_path)
+        result = {"shape": name,
+                  "size": size,
+                  "source_bytes": len(source),
+                  "c_bytes": os.path.getsize(c_path),
+                  "pants_seconds": pants_seconds,
+                  "gcc_seconds": gcc_seconds,
+                  "passes": passes["passes"]}
+        results.append(result)
+        sys.stdout.write("%-6s %7d %10.4f %10.4f %10d %12d\n" % (name, size,
+            pants_seconds, gcc_seconds, result["c_bytes"],
+            max(p["peak_rss_kb"] for p in passes["passes"])))
+  finally:
+    shutil.rmtree(tmp)
+
+  report = open(output, "w")
+  json.dump({"pants": pants, "options": options, "results": results}, report,
+      indent=2, sort_keys=True)
+  report.write("\n")
+  report.close()
+  sys.stdout.write("wrote %s\n" % output)
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main(sys.argv))
@@ -12,6 +12,13 @@ static std::string indent(unsigned int indent_level) {
   return os.str();
 }
 
+bool cps::Call::binary() const {
+  return left_positional_args.size() + right_positional_args.size() == 2 &&
+      left_positional_args.size() <= 1 && !left_arbitrary_arg &&
+      right_optional_args.empty() && !right_arbitrary_arg &&
+      !right_keyword_arg;
+}
+
 std::string cps::Call::format(unsigned int indent_level) const {
   std::ostringstream os;
   os << "Call(\n" << indent(indent_level+1) << "Left(\n"
@@ -52,6 +59,18 @@ std::string cps::Call::format(unsigned int indent_level) const {
   if(continuation.get())
     os << ",\n" << indent(indent_level+1) << "Cont("
        << continuation->format(indent_level+2) << ")";
+  if(tail_call)
+    os << ",\n" << indent(indent_level+1) << "Cont("
+       << CONTINUATION.format(indent_level+2) << ")";
+  if(target.get())
+    os << ",\n" << indent(indent_level+1) << "Target(" << target->c_name()
+       << ")";
+  if(!builtin.empty())
+    os << ",\n" << indent(indent_level+1) << "Builtin(" << builtin << ")";
+  if(self_call) os << ",\n" << indent(indent_level+1) << "SelfCall";
+  for(unsigned int i = 0; i < branches.size(); ++i)
+    os << ",\n" << indent(indent_level+1) << "Branch("
+       << branches[i]->format(indent_level+2) << ")";
   os << ",\n" << indent(indent_level+1) << callable->format(indent_level+1)
      << ")";
   return os.str();
@@ -321,48 +340,6 @@ void cps::transform(const std::vector<PTR<ir::Expression> >& in_ir,
   }
 }
 
-static void callables_in_values(PTR<cps::Value> value,
-    std::vector<PTR<cps::Callable> >& callables) {
-  if(!value) return;
-  PTR<cps::Callable> callable(
-      boost::dynamic_pointer_cast<cps::Callable>(value));
-  if(!callable) return;
-  callables.push_back(callable);
-  callable->expression->callables(callables);
-}
-
-static void free_names_in_values(PTR<cps::Value> value,
-    std::set<cps::Name>& names) {
-  if(!value) return;
-  value->free_names(names);
-}
-
-void cps::Call::callables(std::vector<PTR<cps::Callable> >&
-    callables) {
-  callables_in_values(continuation, callables);
-}
-
-void cps::Assignment::callables(
-    std::vector<PTR<cps::Callable> >& callables) {
-  next_expression->callables(callables);
-  callables_in_values(value, callables);
-}
-
-void cps::Call::free_names(std::set<Name>& names) {
-  names.insert(callable->name);
-  for(unsigned int i = 0; i < left_positional_args.size(); ++i)
-    names.insert(left_positional_args[i]->name);
-  if(!!left_arbitrary_arg) names.insert(left_arbitrary_arg->name);
-  for(unsigned int i = 0; i < right_positional_args.size(); ++i)
-    names.insert(right_positional_args[i]->name);
-  for(unsigned int i = 0; i < right_optional_args.size(); ++i)
-    names.insert(right_optional_args[i].value->name);
-  if(!!right_arbitrary_arg) names.insert(right_arbitrary_arg->name);
-  if(!!right_keyword_arg) names.insert(right_keyword_arg->name);
-  free_names_in_values(continuation, names);
-  names.insert(DYNAMIC_VARS);
-}
-
 static inline void add_unique_name(std::set<cps::Name>& names,
     const cps::Name& name) {
   if(names.find(name) != names.end())
@@ -390,39 +367,3 @@ void cps::Callable::arg_names(std::set<cps::Name>& names) {
   for(std::set<Name>::iterator it(args.begin()); it != args.end(); ++it)
     names.insert(*it);
 }
-
-void cps::Callable::free_names(std::set<cps::Name>& names) {
-  std::set<Name> new_names;
-  expression->free_names(new_names);
-  std::set<Name> args;
-  arg_names(args);
-  for(std::set<Name>::iterator it(args.begin()); it != args.end(); ++it)
-    new_names.erase(*it);
-  for(std::set<Name>::iterator it(new_names.begin());
-      it != new_names.end(); ++it)
-    names.insert(*it);
-  for(unsigned int i = 0; i < left_optional_args.size(); ++i)
-    names.insert(left_optional_args[i].value->name);
-  for(unsigned int i = 0; i < right_optional_args.size(); ++i)
-    names.insert(right_optional_args[i].value->name);
-}
-
-void cps::Assignment::free_names(std::set<cps::Name>& names) {
-  if(!local) {
-    next_expression->free_names(names);
-    value->free_names(names);
-    names.insert(assignee->name);
-    return;
-  }
-  std::set<Name> new_names;
-  next_expression->free_names(new_names);
-  value->free_names(new_names);
-  new_names.erase(assignee->name);
-  for(std::set<Name>::iterator it(new_names.begin());
-      it != new_names.end(); ++it)
-    names.insert(*it);
-}
-
-void cps::Call::frame_names(std::set<Name>& names) {
-  if(continuation) continuation->frame_names(names);
-}
@@ -8,6 +8,10 @@ namespace pants {
 namespace cps {
 
   typedef pants::ir::Name Name;
+
+  // every cps node lives in the cps arena.
+  struct Phase;
+  typedef pants::ArenaNode<Phase> Node;
   struct Callable; struct Field; struct VariableValue; struct Integer;
   struct String; struct Float; struct Callable; struct Call;
   struct Assignment; struct ObjectMutation;
@@ -27,7 +31,7 @@ namespace cps {
     virtual void visit(ObjectMutation*) = 0;
   };
 
-  class Variable : boost::noncopyable {
+  class Variable : public Node, boost::noncopyable {
   public:
     Variable(const Name& name_) : name(name_), m_varidSet(false) {}
     Name name;
@@ -46,11 +50,10 @@ namespace cps {
     unsigned int m_varid;
   };
 
-  struct Value {
+  struct Value : public Node {
     virtual ~Value() {}
     virtual std::string format(unsigned int indent_level) const = 0;
     virtual void accept(ValueVisitor*) = 0;
-    virtual void free_names(std::set<Name>& names) = 0;
     protected: Value() {} };
 
   struct Field : public Value {
@@ -58,7 +61,6 @@ namespace cps {
       : object(object_), field(field_) {}
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
-    void free_names(std::set<Name>& names) { names.insert(object->name); }
     PTR<Variable> object;
     Name field;
   };
@@ -68,7 +70,6 @@ namespace cps {
     PTR<Variable> variable;
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
-    void free_names(std::set<Name>& names) { names.insert(variable->name); }
   };
 
   struct Integer : public Value {
@@ -76,7 +77,6 @@ namespace cps {
     long long value;
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
-    void free_names(std::set<Name>& names) {}
   };
 
   struct String : public Value {
@@ -86,7 +86,6 @@ namespace cps {
     bool byte_oriented;
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
-    void free_names(std::set<Name>& names) {}
   };
 
   struct Float : public Value {
@@ -94,7 +93,6 @@ namespace cps {
     double value;
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
-    void free_names(std::set<Name>& names) {}
   };
 
   struct InDefinition {
@@ -113,17 +111,15 @@ namespace cps {
     std::string format(unsigned int indent_level) const;
   };
 
-  struct Expression {
+  struct Expression : public Node {
     virtual ~Expression() {}
     virtual std::string format(unsigned int indent_level) const = 0;
-    virtual void callables(std::vector<PTR<Callable> >&) = 0;
-    virtual void free_names(std::set<Name>& names) = 0;
-    virtual void frame_names(std::set<Name>& names) = 0;
     virtual void accept(ExpressionVisitor*) = 0;
     protected: Expression() {} };
 
   struct Call : public Expression {
-    Call(PTR<Variable> callable_) : callable(callable_) {}
+    Call(PTR<Variable> callable_)
+      : callable(callable_), tail_call(false), self_call(false) {}
     PTR<Variable> callable;
     std::vector<PTR<Variable> > left_positional_args;
     PTR<Variable> left_arbitrary_arg;
@@ -132,9 +128,33 @@ namespace cps {
     PTR<Variable> right_arbitrary_arg;
     PTR<Variable> right_keyword_arg;
     PTR<Callable> continuation;
-    void callables(std::vector<PTR<Callable> >& callables);
-    void free_names(std::set<Name>& names);
-    void frame_names(std::set<Name>& names);
+    // a call without a continuation of its own either hands the callee the
+    // current function's continuation, so the callee returns straight to
+    // our caller, or is a return itself and passes no continuation at all.
+    bool tail_call;
+    // set by optimize::cps when callable can only ever hold this function.
+    // images are written before that runs and leave it out.
+    PTR<Callable> target;
+    // likewise, the runtime builtin (add, lessthan, ...) callable can only
+    // ever hold, if it's one of the operators. break and continue mark a
+    // call to the prelude's that jumps straight out of (or back around) the
+    // while written in place it's in.
+    std::string builtin;
+    // an if whose blocks were written right where it's called gets them
+    // here, turned into continuations of the function making the call, and
+    // just the condition is left as an argument. the then block comes first,
+    // and the else block, if there is one, second. a while gets its test and
+    // then its body, with no arguments left, and the body takes the variable
+    // its dynamic variables are kept in. also set by optimize::cps.
+    std::vector<PTR<Callable> > branches;
+    // a tail call from a function back into itself, handing it its own
+    // continuation and exactly the positional arguments it takes, so the
+    // call can just go back to where those get bound. also set by
+    // optimize::cps.
+    bool self_call;
+    // exactly two positional arguments, at most one of them on the left,
+    // and nothing else.
+    bool binary() const;
     std::string format(unsigned int indent_level) const;
     void accept(ExpressionVisitor* v) { v->visit(this); }
   };
@@ -148,12 +168,6 @@ namespace cps {
     PTR<Value> value;
     bool local;
     PTR<Expression> next_expression;
-    void callables(std::vector<PTR<Callable> >& callables);
-    void free_names(std::set<Name>& names);
-    void frame_names(std::set<Name>& names) {
-      if(local) names.insert(assignee->name);
-      next_expression->frame_names(names);
-    }
     std::string format(unsigned int indent_level) const;
     void accept(ExpressionVisitor* v) { v->visit(this); }
   };
@@ -167,22 +181,14 @@ namespace cps {
     Name field;
     PTR<Variable> value;
     PTR<Expression> next_expression;
-    void callables(std::vector<PTR<Callable> >& callables)
-      { next_expression->callables(callables); }
-    void free_names(std::set<Name>& names) {
-      next_expression->free_names(names);
-      names.insert(object->name);
-      names.insert(value->name);
-    }
-    void frame_names(std::set<Name>& names) {
-      next_expression->frame_names(names);
-    }
     std::string format(unsigned int indent_level) const;
     void accept(ExpressionVisitor* v) { v->visit(this); }
   };
 
   struct Callable : public Value {
-    Callable(bool function_) : varid(m_varcount++), function(function_) {}
+    Callable(bool function_)
+      : varid(m_varcount++), function(function_), self_called(false),
+        frame_escapes(true), environment(COPIED), m_namesSet(false) {}
     PTR<Expression> expression;
     std::vector<PTR<Variable> > left_positional_args;
     std::vector<InDefinition> left_optional_args;
@@ -193,6 +199,16 @@ namespace cps {
     PTR<Variable> right_keyword_arg;
     unsigned int varid;
     bool function;
+    // whether a function makes any self calls. set along with them.
+    bool self_called;
+    // whether anything could still be holding on to a function's frame once
+    // it has returned. also filled in by annotate::names.
+    bool frame_escapes;
+    // where a function's environment comes from when it's made: a copy of
+    // its free names, or the environment or frame of the function making
+    // it. also filled in by annotate::names.
+    enum Environment { COPIED, SHARED_ENV, SHARED_FRAME };
+    Environment environment;
     std::string c_name() const {
       std::ostringstream os;
       os << "f_" << varid;
@@ -201,12 +217,40 @@ namespace cps {
     std::string format(unsigned int indent_level) const;
     void accept(ValueVisitor* v) { v->visit(this); }
     void arg_names(std::set<Name>& names);
-    void free_names(std::set<Name>& names);
-    void frame_names(std::set<Name>& names) {
-      arg_names(names);
-      expression->frame_names(names);
+    // free and frame names are filled in by annotate::names, and only for
+    // functions.
+    void setNames(const std::set<Name>& free_names,
+        const std::set<Name>& frame_names) {
+      m_namesSet = true;
+      m_freeNames = free_names;
+      m_frameNames = frame_names;
+      m_environmentNames = free_names;
+    }
+    const std::set<Name>& getFreeNames() const {
+      if(!m_namesSet) throw expectation_failure("names unset!");
+      return m_freeNames;
     }
-    private: static unsigned int m_varcount;
+    const std::set<Name>& getFrameNames() const {
+      if(!m_namesSet) throw expectation_failure("names unset!");
+      return m_frameNames;
+    }
+    // everything the environment holds, which is more than the free names
+    // if it's shared.
+    void setEnvironment(Environment environment_,
+        const std::set<Name>& names) {
+      environment = environment_;
+      m_environmentNames = names;
+    }
+    const std::set<Name>& getEnvironmentNames() const {
+      if(!m_namesSet) throw expectation_failure("names unset!");
+      return m_environmentNames;
+    }
+  private:
+    static unsigned int m_varcount;
+    bool m_namesSet;
+    std::set<Name> m_freeNames;
+    std::set<Name> m_frameNames;
+    std::set<Name> m_environmentNames;
   };
 
   void transform(const std::vector<PTR<pants::ir::Expression> >& in_ir,
@@ -2,15 +2,25 @@
 
 __author__ = "JT Olds <hello@jtolds.com>"
 
-import os, re, sys
+import os, re, subprocess, sys
 
-def generate(dir_name):
+def cache_prelude(dir_name, cache_tool):
+  tool = subprocess.Popen([cache_tool],
+      stdin=file(os.path.join(dir_name, "prelude.p")), stdout=subprocess.PIPE)
+  data = tool.communicate()[0]
+  if tool.returncode != 0:
+    raise Exception("%s failed caching the prelude" % cache_tool)
+  return data
+
+def generate(dir_name, cache_tool=None):
   NON_ALPHANUM = re.compile(r'[^a-zA-Z0-9]')
 
   assets = {}
   for asset in os.listdir(dir_name):
     assets[NON_ALPHANUM.sub('_', asset.upper())] = \
         file(os.path.join(dir_name, asset)).read()
+  if cache_tool is not None:
+    assets["PRELUDE_CACHE"] = cache_prelude(dir_name, cache_tool)
 
   header = file("%s.h" % dir_name, "w")
   header.write("#ifndef __%s_H__\n" % dir_name.upper())
@@ -20,6 +30,7 @@ def generate(dir_name):
   header.write("namespace pants {\nnamespace %s {\n\n" % dir_name)
   for name in assets.keys():
     header.write("extern const char* %s;\n" % name)
+    header.write("extern const unsigned int %s_SIZE;\n" % name)
   header.write("\n}}\n\n#endif\n")
   header.close()
 
@@ -33,8 +44,13 @@ def generate(dir_name):
       if i == 0: body.write("\n  \"")
       body.write("\\x%02x" % ord(char))
       if i % 18 == 17: body.write("\"\n  \"")
-    body.write("\\x00\";\n\n")
+    body.write("\\x00\";\n")
+    body.write("const unsigned int pants::%s::%s_SIZE = %d;\n\n" % (dir_name,
+        name, len(data)))
 
 
 if __name__ == "__main__":
-  generate(sys.argv[1])
+  if len(sys.argv) > 2:
+    generate(sys.argv[1], sys.argv[2])
+  else:
+    generate(sys.argv[1])
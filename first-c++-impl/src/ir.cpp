@@ -1,4 +1,5 @@
 #include "ir.h"
+#include <deque>
 
 using namespace pants;
 
@@ -362,31 +363,95 @@ void ir::convert(const std::vector<PTR<ast::Expression> >& ast,
     std::vector<PTR<ir::Expression> >& ir,
     ir::Name& lastval) {
   unsigned long long varcount = 0;
+  convert(ast, ir, lastval, varcount);
+}
+
+void ir::convert(const std::vector<PTR<ast::Expression> >& ast,
+    std::vector<PTR<ir::Expression> >& ir,
+    ir::Name& lastval, unsigned long long& varcount) {
   ConversionVisitor visitor(&ir, &lastval, &varcount);
   visitor.visit(ast);
 }
 
-std::string pants::ir::Name::format(unsigned int) const {
-  std::ostringstream os;
-  os << (user_provided ? "u" : "c")
-     << "_"
-     << name;
-  return os.str();
+namespace {
+
+  struct Symbol {
+    Symbol(const std::string& name_, bool user_provided_)
+      : name(name_), user_provided(user_provided_)
+    {
+      std::ostringstream os;
+      os << std::hex;
+      os << (user_provided ? "u_" : "c_");
+      for(unsigned int i = 0; i < name.size(); ++i) {
+        if(isalnum(name[i])) {
+          os << name[i];
+        } else if(name[i] == '_') {
+          os << "__";
+        } else {
+          os << "_" << ((int)name[i]);
+        }
+      }
+      c_name = os.str();
+    }
+    std::string name;
+    bool user_provided;
+    std::string c_name;
+  };
+
+  // a deque, so references to symbols stay good as the table grows.
+  struct SymbolTable {
+    SymbolTable() : frozen(false) {}
+    std::deque<Symbol> symbols;
+    std::map<std::pair<std::string, bool>, unsigned int> ids;
+    bool frozen;
+  };
+
+  SymbolTable& symbol_table() {
+    static SymbolTable table;
+    return table;
+  }
+
+}
+
+unsigned int pants::ir::Name::intern(const std::string& name,
+    bool user_provided) {
+  SymbolTable& table(symbol_table());
+  // names that already exist are found without touching the table, so
+  // threads can construct them concurrently. a frozen table can't grow.
+  std::map<std::pair<std::string, bool>, unsigned int>::const_iterator it(
+      table.ids.find(std::make_pair(name, user_provided)));
+  if(it != table.ids.end()) return it->second;
+  if(table.frozen)
+    throw expectation_failure("new name interned while frozen: " + name);
+  std::pair<std::map<std::pair<std::string, bool>, unsigned int>::iterator,
+      bool> inserted(table.ids.insert(std::make_pair(std::make_pair(name,
+      user_provided), table.symbols.size())));
+  if(inserted.second)
+    table.symbols.push_back(Symbol(name, user_provided));
+  return inserted.first->second;
+}
+
+void pants::ir::Name::freeze(bool frozen) {
+  symbol_table().frozen = frozen;
+}
+
+const std::string& pants::ir::Name::name() const {
+  return symbol_table().symbols[m_id].name;
 }
 
-std::string pants::ir::Name::c_name() const {
+bool pants::ir::Name::user_provided() const {
+  return symbol_table().symbols[m_id].user_provided;
+}
+
+const std::string& pants::ir::Name::c_name() const {
+  return symbol_table().symbols[m_id].c_name;
+}
+
+std::string pants::ir::Name::format(unsigned int) const {
   std::ostringstream os;
-  os << std::hex;
-  os << (user_provided ? "u_" : "c_");
-  for(unsigned int i = 0; i < name.size(); ++i) {
-    if(isalnum(name[i])) {
-      os << name[i];
-    } else if(name[i] == '_') {
-      os << "__";
-    } else {
-      os << "_" << ((int)name[i]);
-    }
-  }
+  os << (user_provided() ? "u" : "c")
+     << "_"
+     << name();
   return os.str();
 }
 
@@ -18,6 +18,10 @@
 namespace pants {
 namespace ir {
 
+  // every ir node lives in the ir arena.
+  struct Phase;
+  typedef pants::ArenaNode<Phase> Node;
+
   struct Assignment; struct ObjectMutation; struct ReturnValue;
 
   struct ExpressionVisitor {
@@ -39,35 +43,46 @@ namespace ir {
     virtual void visit(Function*) = 0;
   };
 
-  struct Expression {
+  struct Expression : public Node {
     virtual ~Expression() {}
     virtual std::string format(unsigned int indent_level) const = 0;
     virtual void accept(ExpressionVisitor* visitor) = 0;
     protected: Expression() {} };
 
-  struct Value {
+  struct Value : public Node {
     virtual ~Value() {}
     virtual std::string format(unsigned int indent_level) const = 0;
     virtual void accept(ValueVisitor* visitor) = 0;
     protected: Value() {} };
 
-  struct Name {
-    Name(const std::string& name_, bool user_provided_)
-      : name(name_), user_provided(user_provided_) {}
-    Name(const pants::ast::Variable& var)
-      : name(var.name), user_provided(var.user_provided)
-      { if(!name.size()) throw expectation_failure("expected variable name"); }
-    std::string format(unsigned int indent_level = 0) const;
-    std::string c_name() const;
-    std::string name;
-    bool user_provided;
-    bool operator<(const Name& rhs) const {
-      if (name < rhs.name) return true;
-      if (rhs.name < name) return false;
-      return user_provided < rhs.user_provided;
-    }
-    bool operator==(const Name& rhs) const
-      { return name == rhs.name && user_provided == rhs.user_provided; }
+  // names are interned into a global symbol table on construction. a Name
+  // is just the index of its symbol, so copying, comparing and using names
+  // as set or map keys never touches the strings. names order by when they
+  // were first interned, not alphabetically. interning isn't locked:
+  // compile::compile interns the names code generation builds up front and
+  // freezes the table while its workers run, so a new name there throws
+  // instead of racing with the lookups.
+  class Name {
+    public:
+      Name(const std::string& name, bool user_provided)
+        : m_id(intern(name, user_provided)) {}
+      Name(const pants::ast::Variable& var)
+        : m_id(intern(var.name, var.user_provided))
+        { if(!var.name.size()) throw expectation_failure("expected variable name"); }
+      const std::string& name() const;
+      bool user_provided() const;
+      // the mangled C identifier, computed once when the name is interned.
+      const std::string& c_name() const;
+      std::string format(unsigned int indent_level = 0) const;
+      unsigned int id() const { return m_id; }
+      bool operator<(const Name& rhs) const { return m_id < rhs.m_id; }
+      bool operator==(const Name& rhs) const { return m_id == rhs.m_id; }
+      bool operator!=(const Name& rhs) const { return m_id != rhs.m_id; }
+      // while frozen, interning a name that doesn't exist yet throws.
+      static void freeze(bool frozen);
+    private:
+      static unsigned int intern(const std::string& name, bool user_provided);
+      unsigned int m_id;
   };
 
   struct Assignment : public Expression {
@@ -160,7 +175,7 @@ namespace ir {
     std::string format(unsigned int indent_level) const;
   };
 
-  struct Call {
+  struct Call : public Node {
     Call(const Name& callable_) : callable(callable_) {}
     Name callable;
     std::vector<PositionalOutArgument> left_positional_args;
@@ -225,6 +240,11 @@ namespace ir {
   void convert(const std::vector<PTR<pants::ast::Expression> >& exps,
       std::vector<PTR<pants::ir::Expression> >& out,
       pants::ir::Name& lastval);
+  // same, but gensyms continue on from varcount, which is updated. used when
+  // converting a program that gets spliced after previously converted code.
+  void convert(const std::vector<PTR<pants::ast::Expression> >& exps,
+      std::vector<PTR<pants::ir::Expression> >& out,
+      pants::ir::Name& lastval, unsigned long long& varcount);
 
 }}
 
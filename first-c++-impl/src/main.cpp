@@ -6,69 +6,247 @@
 #include "compile.h"
 #include "optimize.h"
 #include <iostream>
+#include <cstdlib>
 #include "assets.h"
 #include "annotate.h"
+#include "serialize.h"
+#include "timing.h"
+#include "module.h"
+#include "server.h"
+#include <boost/thread.hpp>
 
 using namespace pants;
 
-int main(int argc, char** argv) {
+// the prelude image, read once up front by --serve.
+struct Prelude {
+  Prelude() : hole(NULL), varcount(0) {}
+  PTR<cps::Expression> cps;
+  PTR<cps::Expression>* hole;
+  unsigned long long varcount;
+};
 
-  bool include_prelude = true;
-  bool use_gc = true;
+struct Options {
+  Options() : include_prelude(true), use_gc(true), jobs(0),
+    time_passes(false), time_passes_json(false) {}
+  bool include_prelude;
+  bool use_gc;
+  std::string prelude_cache;
+  unsigned int jobs;
+  bool time_passes;
+  bool time_passes_json;
+};
 
-  for(int i = 1; i < argc; ++i) {
-    if(argv[i] == std::string("--skip-prelude")) {
-      include_prelude = false;
+// returns -1 if there's a compile to do, or else the exit status.
+static int parse_options(const std::vector<std::string>& args,
+    Options& options, std::ostream& out, std::ostream& err) {
+  for(unsigned int i = 0; i < args.size(); ++i) {
+    if(args[i] == "--skip-prelude") {
+      options.include_prelude = false;
+      continue;
+    }
+    if(args[i] == "--no-gc") {
+      options.use_gc = false;
+      continue;
+    }
+    if(args[i].find("--prelude-cache=") == 0) {
+      options.prelude_cache = args[i].substr(16);
+      continue;
+    }
+    if(args[i].find("--jobs=") == 0) {
+      options.jobs = strtoul(args[i].c_str() + 7, NULL, 10);
+      continue;
+    }
+    if(args[i] == "--time-passes") {
+      options.time_passes = true;
       continue;
     }
-    if(argv[i] == std::string("--no-gc")) {
-      use_gc = false;
+    if(args[i] == "--time-passes=json") {
+      options.time_passes = options.time_passes_json = true;
       continue;
     }
-    if(argv[i] == std::string("--help")) {
-      std::cout << "usage: " << argv[0] << " [--skip-prelude]" << std::endl;
-      std::cout << "  source comes in stdin, C comes out stdout" << std::endl;
+    if(args[i] == "--help") {
+      out << "usage: pants [--skip-prelude] [--no-gc] "
+             "[--prelude-cache=<file>] [--jobs=<threads>]\n"
+             "    [--time-passes[=json]]\n"
+             "       pants --serve[=<socket>]" << std::endl;
+      out << "  source comes in stdin, C comes out stdout" << std::endl;
+      out << "  --time-passes reports time, memory and sizes per "
+             "compiler pass on stderr" << std::endl;
+      out << "  --serve keeps a compiler running for pants_client, on "
+             "$PANTS_SOCKET or\n    " << server::default_socket()
+          << " by default" << std::endl;
       return 0;
     }
-    std::cerr << "unknown argument! try --help" << std::endl;
+    err << "unknown argument! try --help" << std::endl;
     return 1;
   }
 
-  std::string str;
-  std::ostringstream os;
-  if(include_prelude) os << assets::PRELUDE_P << "\n";
+  return -1;
+}
 
-  while(getline(std::cin, str)) {
-    os << str << '\n';
-  }
+static int compile_source(const Options& options, const std::string& source,
+    std::ostream& out, std::ostream& err, const Prelude* preloaded) {
+  timing::Report report;
+  timing::CountingBuffer output_buffer(out.rdbuf());
+  std::ostream output(&output_buffer);
 
   try {
+    // the prelude (along with the wrapped builtins) comes precompiled. the
+    // program gets spliced into the hole where the prelude would have ended.
+    PTR<cps::Expression> cps;
+    PTR<cps::Expression>* prelude_hole = NULL;
+    unsigned long long varcount = 0;
+    report.start("prelude");
+    if(options.include_prelude) {
+      if(options.prelude_cache.size() > 0) {
+        serialize::read_cps_file(options.prelude_cache, cps, prelude_hole,
+            varcount);
+      } else if(preloaded) {
+        cps = preloaded->cps;
+        prelude_hole = preloaded->hole;
+        varcount = preloaded->varcount;
+      } else {
+        serialize::read_cps(assets::PRELUDE_CACHE, assets::PRELUDE_CACHE_SIZE,
+            cps, prelude_hole, varcount);
+      }
+    }
+    report.stop();
+    // the cps arena keeps the prelude's nodes until exit, so the program's
+    // own counts below leave them out.
+    size_t prelude_nodes = cps::Node::arena().nodes();
+    size_t prelude_bytes = cps::Node::arena().bytes();
+    report.count("cps_nodes", prelude_nodes);
+
+    report.start("parse");
     std::vector<PTR<ast::Expression> > ast;
-    bool r = parser::parse(os.str(), ast);
+    bool r = parser::parse(source, ast);
     if(!r) throw expectation_failure("failed parsing!");
+    report.stop();
+    report.count("source_bytes", source.size());
+    report.count("ast_nodes", ast::Node::arena().nodes());
+    report.count("ast_bytes", ast::Node::arena().bytes());
 
+    report.start("module::link");
+    std::vector<std::string> imports;
+    std::set<std::string> defined;
+    module::imports(ast, imports);
+    if(!imports.empty())
+      module::link(imports, ".", prelude_hole, varcount, defined);
+    report.stop();
+    report.count("imports", imports.size());
+
+    report.start("ir::convert");
     std::vector<PTR<ir::Expression> > ir;
-    wrap::ir_prepend(ir);
+    if(!options.include_prelude) wrap::ir_prepend(ir);
     ir::Name lastval(NULL_VALUE);
-    ir::convert(ast, ir, lastval);
+    ir::convert(ast, ir, lastval, varcount);
     lastval = NULL_VALUE;
     ast.clear();
-    optimize::ir(ir);
+    ast::Node::arena().clear();
+    report.stop();
+    report.count("ir_nodes", ir::Node::arena().nodes());
+    report.count("ir_bytes", ir::Node::arena().bytes());
 
-    PTR<cps::Expression> cps;
-    cps::transform(ir, lastval, cps);
+    report.start("optimize::ir");
+    optimize::ir(ir, &defined, options.include_prelude, varcount);
+    report.stop();
+
+    report.start("cps::transform");
+    PTR<cps::Expression> program;
+    cps::transform(ir, lastval, program);
     ir.clear();
+    ir::Node::arena().clear();
+    if(prelude_hole) {
+      *prelude_hole = program;
+    } else {
+      cps = program;
+    }
+    report.stop();
+    report.count("cps_nodes", cps::Node::arena().nodes() - prelude_nodes);
+    report.count("cps_bytes", cps::Node::arena().bytes() - prelude_bytes);
 
+    report.start("annotate::varids");
     annotate::DataStore store;
     annotate::varids(cps, store);
+    report.stop();
+
+    report.start("optimize::cps");
+    optimize::cps(cps, store, options.include_prelude);
+    report.stop();
 
-    optimize::cps(cps, store);
+    report.start("annotate::types");
+    annotate::types(cps, store);
+    report.stop();
 
-    compile::compile(cps, store, std::cout, use_gc);
+    report.start("annotate::names");
+    annotate::names(cps, store);
+    report.stop();
+    report.count("callables", store.callables().size());
+
+    report.start("compile::compile");
+    compile::Statistics stats;
+    compile::compile(cps, store, output, options.use_gc, options.jobs,
+        &stats);
+    output.flush();
+    report.stop();
+    report.count("functions", stats.functions);
+    report.count("namesets", stats.namesets);
+    report.count("c_bytes", output_buffer.bytes());
   } catch (const std::exception& e) {
-    std::cerr << "failure: " << e.what() << std::endl;
+    err << "failure: " << e.what() << std::endl;
     return 1;
   }
 
+  if(options.time_passes) {
+    if(options.time_passes_json) {
+      report.writeJSON(err);
+    } else {
+      report.write(err);
+    }
+  }
+
   return 0;
 }
+
+static int handle_request(const std::vector<std::string>& args,
+    const std::string& source, std::ostream& out, std::ostream& err,
+    const Prelude* preloaded) {
+  Options options;
+  int status = parse_options(args, options, out, err);
+  if(status >= 0) return status;
+  return compile_source(options, source, out, err, preloaded);
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+
+  if(args.size() == 1 && (args[0] == "--serve" ||
+      args[0].find("--serve=") == 0)) {
+    std::string socket(args[0] == "--serve" ? server::default_socket() :
+        args[0].substr(8));
+    // every request is forked off with the prelude already read in.
+    Prelude prelude;
+    try {
+      serialize::read_cps(assets::PRELUDE_CACHE, assets::PRELUDE_CACHE_SIZE,
+          prelude.cps, prelude.hole, prelude.varcount);
+      server::serve(socket, boost::bind(handle_request, _1, _2, _3, _4,
+          &prelude), boost::thread::hardware_concurrency());
+    } catch (const std::exception& e) {
+      std::cerr << "failure: " << e.what() << std::endl;
+    }
+    return 1;
+  }
+
+  Options options;
+  int status = parse_options(args, options, std::cout, std::cerr);
+  if(status >= 0) return status;
+
+  std::string str;
+  std::ostringstream os;
+
+  while(getline(std::cin, str)) {
+    os << str << '\n';
+  }
+
+  return compile_source(options, os.str(), std::cout, std::cerr, NULL);
+}
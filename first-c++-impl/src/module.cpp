@@ -0,0 +1,252 @@
+#include "module.h"
+#include "parser.h"
+#include "ir.h"
+#include "optimize.h"
+#include "annotate.h"
+#include "serialize.h"
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace pants;
+
+#define IMPORT_NAME "import"
+#define IMAGE_SUFFIX ".cps"
+
+static bool string_term(PTR<ast::Term> term, std::string& value) {
+  if(!term->trailers.empty()) return false;
+  if(ast::CharString* str = dynamic_cast<ast::CharString*>(
+      term->value.get())) {
+    value = str->value;
+    return true;
+  }
+  if(ast::ByteString* str = dynamic_cast<ast::ByteString*>(
+      term->value.get())) {
+    value = str->value;
+    return true;
+  }
+  return false;
+}
+
+static bool import_statement(PTR<ast::Expression> exp, std::string& path) {
+  ast::Application* app(dynamic_cast<ast::Application*>(exp.get()));
+  if(!app || app->terms.empty()) return false;
+  ast::Variable* var(dynamic_cast<ast::Variable*>(
+      app->terms[0]->value.get()));
+  if(!var || !var->user_provided || var->name != IMPORT_NAME) return false;
+
+  const std::vector<PTR<ast::ValueModifier> >& trailers(
+      app->terms[0]->trailers);
+  // import "path"
+  if(app->terms.size() == 2 && (trailers.empty() || (trailers.size() == 1 &&
+      dynamic_cast<ast::OpenCall*>(trailers[0].get()))) &&
+      string_term(app->terms[1], path))
+    return true;
+  // import("path")
+  if(app->terms.size() == 1 && trailers.size() == 1) {
+    ast::ClosedCall* call(dynamic_cast<ast::ClosedCall*>(trailers[0].get()));
+    if(call && call->left_required_args.empty() &&
+        !call->left_arbitrary_arg && call->right_required_args.size() == 1 &&
+        call->right_optional_args.empty() && !call->right_arbitrary_arg &&
+        !call->right_keyword_arg) {
+      ast::Application* arg(dynamic_cast<ast::Application*>(
+          call->right_required_args[0].application.get()));
+      if(arg && arg->terms.size() == 1 && string_term(arg->terms[0], path))
+        return true;
+    }
+  }
+  throw expectation_failure("import takes a single string literal");
+}
+
+void pants::module::imports(std::vector<PTR<ast::Expression> >& ast,
+    std::vector<std::string>& paths) {
+  std::vector<PTR<ast::Expression> > rest;
+  for(unsigned int i = 0; i < ast.size(); ++i) {
+    std::string path;
+    if(import_statement(ast[i], path)) {
+      paths.push_back(path);
+    } else {
+      rest.push_back(ast[i]);
+    }
+  }
+  ast.swap(rest);
+}
+
+static std::string directory(const std::string& path) {
+  std::string::size_type slash(path.rfind('/'));
+  if(slash == std::string::npos) return ".";
+  if(slash == 0) return "/";
+  return path.substr(0, slash);
+}
+
+static std::string resolve(const std::string& path, const std::string& dir) {
+  std::string full(path.size() > 0 && path[0] == '/' ? path :
+      dir + "/" + path);
+  char resolved[PATH_MAX];
+  if(!realpath(full.c_str(), resolved))
+    throw expectation_failure("unable to find module " + full);
+  return resolved;
+}
+
+// a hash of the running compiler, which has the prelude built in, so an image
+// built by any other compiler or against any other prelude isn't trusted.
+// empty if the binary can't be read, in which case nothing is.
+static const std::string& fingerprint() {
+  static std::string result;
+  static bool done = false;
+  if(done) return result;
+  done = true;
+  std::ifstream exe("/proc/self/exe", std::ios::binary);
+  if(!exe) return result;
+  unsigned long long hash = 14695981039346656037ULL;
+  unsigned long long size = 0;
+  char buffer[1 << 16];
+  while(exe.read(buffer, sizeof(buffer)) || exe.gcount() > 0) {
+    for(std::streamsize i = 0; i < exe.gcount(); ++i) {
+      hash ^= (unsigned char)buffer[i];
+      hash *= 1099511628211ULL;
+    }
+    size += exe.gcount();
+  }
+  std::ostringstream os;
+  os << std::hex << hash << "-" << size;
+  result = os.str();
+  return result;
+}
+
+// mtimes only have a resolution of a second, so an image from the same
+// second as its source doesn't count.
+static bool newer(const std::string& image, const std::string& source) {
+  struct stat image_info, source_info;
+  if(stat(image.c_str(), &image_info) != 0) return false;
+  if(stat(source.c_str(), &source_info) != 0) return false;
+  return image_info.st_mtime > source_info.st_mtime;
+}
+
+// compiles the module at path by itself, the same way cache_prelude builds
+// the prelude, and caches the image if it can.
+static std::string compile_module(const std::string& path) {
+  std::ifstream in(path.c_str());
+  if(!in) throw expectation_failure("unable to open module " + path);
+  std::ostringstream src;
+  src << in.rdbuf();
+
+  std::vector<PTR<ast::Expression> > ast;
+  if(!parser::parse(src.str(), ast))
+    throw expectation_failure("failed parsing " + path);
+  serialize::ModuleInfo info;
+  module::imports(ast, info.imports);
+  info.fingerprint = fingerprint();
+
+  std::vector<PTR<ir::Expression> > ir;
+  ir::Name lastval(NULL_VALUE);
+  unsigned long long varcount = 0;
+  ir::convert(ast, ir, lastval, varcount);
+  lastval = NULL_VALUE;
+  // what this module's imports define isn't known until they're linked.
+  std::set<std::string> defined;
+  optimize::ir(ir, info.imports.empty() ? &defined : NULL, true,
+      varcount);
+
+  PTR<cps::Expression> cps;
+  cps::transform(ir, lastval, cps);
+
+  annotate::DataStore store;
+  annotate::names(cps, store);
+  for(std::set<cps::Name>::const_iterator it(store.frameNames().begin());
+      it != store.frameNames().end(); ++it) {
+    if(it->user_provided()) info.exports.push_back(it->name());
+  }
+
+  std::ostringstream image;
+  serialize::write_cps(cps, varcount, image, info);
+
+  // write somewhere private and rename, so a concurrent build never sees a
+  // partial image. a read-only source tree just goes without a cache.
+  std::ostringstream tmp;
+  tmp << path << IMAGE_SUFFIX << "." << getpid();
+  std::ofstream out(tmp.str().c_str(), std::ios::binary);
+  out << image.str();
+  out.close();
+  if(out.fail() ||
+      rename(tmp.str().c_str(), (path + IMAGE_SUFFIX).c_str()) != 0)
+    unlink(tmp.str().c_str());
+  return image.str();
+}
+
+class Linker : boost::noncopyable {
+  public:
+    Linker(PTR<cps::Expression>*& hole, unsigned long long& ir_varcount,
+        std::set<std::string>& defined)
+      : m_hole(hole), m_varcount(ir_varcount), m_defined(defined) {}
+
+    void load(const std::string& import, const std::string& dir) {
+      std::string path(resolve(import, dir));
+      if(m_linked.find(path) != m_linked.end()) return;
+      if(m_linking.find(path) != m_linking.end())
+        throw expectation_failure("import cycle through " + path);
+      m_linking.insert(path);
+
+      PTR<cps::Expression> cps;
+      PTR<cps::Expression>* hole = NULL;
+      serialize::ModuleInfo info;
+      std::string image(path + IMAGE_SUFFIX);
+      bool loaded = false;
+      if(!fingerprint().empty() && newer(image, path)) {
+        // a stale or foreign image just gets rebuilt. the gensym count is
+        // put back, since reading moves it past the image's gensyms.
+        unsigned long long varcount(m_varcount);
+        try {
+          serialize::read_cps_file(image, cps, hole, varcount, &info);
+          if(info.fingerprint == fingerprint()) {
+            m_varcount = varcount;
+            loaded = true;
+          }
+        } catch (const expectation_failure&) {}
+        if(!loaded) info = serialize::ModuleInfo();
+      }
+      if(!loaded) {
+        std::string data(compile_module(path));
+        serialize::read_cps(data.data(), data.size(), cps, hole, m_varcount,
+            &info);
+      }
+
+      for(unsigned int i = 0; i < info.imports.size(); ++i)
+        load(info.imports[i], directory(path));
+
+      for(unsigned int i = 0; i < info.exports.size(); ++i) {
+        std::map<std::string, std::string>::const_iterator it(
+            m_exports.find(info.exports[i]));
+        if(it != m_exports.end()) {
+          throw expectation_failure(info.exports[i] + " is defined by both " +
+              it->second + " and " + path);
+        }
+        m_exports[info.exports[i]] = path;
+        m_defined.insert(info.exports[i]);
+      }
+
+      *m_hole = cps;
+      m_hole = hole;
+      m_linking.erase(path);
+      m_linked.insert(path);
+    }
+
+  private:
+    PTR<cps::Expression>*& m_hole;
+    unsigned long long& m_varcount;
+    std::set<std::string>& m_defined;
+    std::set<std::string> m_linking;
+    std::set<std::string> m_linked;
+    std::map<std::string, std::string> m_exports;
+};
+
+void pants::module::link(const std::vector<std::string>& paths,
+    const std::string& dir, PTR<cps::Expression>*& hole,
+    unsigned long long& ir_varcount, std::set<std::string>& defined) {
+  if(!hole) throw expectation_failure("imports need the prelude");
+  Linker linker(hole, ir_varcount, defined);
+  for(unsigned int i = 0; i < paths.size(); ++i) linker.load(paths[i], dir);
+}
@@ -0,0 +1,31 @@
+#ifndef __MODULE_H__
+#define __MODULE_H__
+
+#include "common.h"
+#include "ast.h"
+#include "cps.h"
+
+namespace pants {
+namespace module {
+
+  // takes the top-level import statements (import "path" or import("path"))
+  // out of a parsed file and returns the paths they name.
+  void imports(std::vector<PTR<pants::ast::Expression> >& ast,
+      std::vector<std::string>& paths);
+
+  // splices the given modules, and everything they import, into hole, each
+  // module once and after everything it imports. hole is left pointing past
+  // the last module. relative paths are looked up from dir.
+  //
+  // every module is compiled on its own into a cps image, which is cached
+  // next to the source as <path>.cps and reused until the source, the
+  // compiler or the prelude changes.
+  // two modules defining the same top-level name is an error. the names the
+  // modules define are added to defined.
+  void link(const std::vector<std::string>& paths, const std::string& dir,
+      PTR<pants::cps::Expression>*& hole, unsigned long long& ir_varcount,
+      std::set<std::string>& defined);
+
+}}
+
+#endif
@@ -1,10 +1,1483 @@
 #include "optimize.h"
+#include <climits>
+#include <boost/math/special_functions/fpclassify.hpp>
 
 using namespace pants;
 
-void pants::optimize::ir(std::vector<PTR<ir::Expression> >& ir) {
+namespace {
+
+  // the operators wrap.cpp binds straight to a runtime builtin.
+  enum Builtin { NONE, ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO, EQUALS,
+      LESSTHAN };
+
+  struct Operator {
+    const char* user_name;
+    const char* c_name;
+    Builtin builtin;
+  };
+
+  const Operator OPERATORS[] = {
+    {"+", "add", ADD},
+    {"-", "subtract", SUBTRACT},
+    {"*", "multiply", MULTIPLY},
+    {"/", "divide", DIVIDE},
+    {"%", "modulo", MODULO},
+    {"==", "equals", EQUALS},
+    {"<", "lessthan", LESSTHAN}};
+
+  const Operator* find_operator(const ir::Name& name) {
+    if(!name.user_provided()) return NULL;
+    for(unsigned int i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); ++i)
+      if(name.name() == OPERATORS[i].user_name) return &OPERATORS[i];
+    return NULL;
+  }
+
+  // builtins that aren't operators, but that compile still writes out in
+  // place.
+  const Operator SPECIAL_FORMS[] = {
+    {"if", "if", NONE},
+    {"while", "while", NONE}};
+
+  // the runtime's own name for an operator's (or special form's) builtin.
+  const Operator* find_builtin(const ir::Name& name) {
+    if(name.user_provided()) return NULL;
+    for(unsigned int i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); ++i)
+      if(name.name() == OPERATORS[i].c_name) return &OPERATORS[i];
+    for(unsigned int i = 0;
+        i < sizeof(SPECIAL_FORMS) / sizeof(SPECIAL_FORMS[0]); ++i)
+      if(name.name() == SPECIAL_FORMS[i].c_name) return &SPECIAL_FORMS[i];
+    return NULL;
+  }
+
+  // the prelude's boolean functions, unless, and the comparisons it builds
+  // out of < and ==, that a call giving them a fixed number of arguments can
+  // have written out in its place.
+  enum Combinator { AND, OR, NOT, UNLESS, LESSEQUAL, GREATER, GREATEREQUAL,
+      NOTEQUAL };
+
+  // every name the prelude's definition of a combinator looks up when it
+  // runs, its own included. if the program binds any of them, the
+  // definition could do something else than what gets written in its place.
+  const char* const NOT_NAMES[] = {"not", "if", "true", "false", NULL};
+  const char* const UNLESS_NAMES[] = {"unless", "if", "==", "null", NULL};
+  const char* const JUNCTION_NAMES[] = {"and", "or", "function", "fold",
+      "each", "while", "<", "+", "demand-thunk", "if", "==", "type",
+      "Function", "true", "false", "null", NULL};
+  const char* const COMPARISON_NAMES[] = {"<=", ">", ">=", "!=", "not",
+      "binary_function", "assert", "unless", "and", "or", "function", "fold",
+      "each", "while", "<", "+", "demand-thunk", "if", "==", "type",
+      "Function", "true", "false", "null", NULL};
+
+  struct PreludeFunction {
+    const char* user_name;
+    Combinator combinator;
+    const char* const* names;
+  };
+
+  const PreludeFunction COMBINATORS[] = {
+    {"and", AND, JUNCTION_NAMES},
+    {"or", OR, JUNCTION_NAMES},
+    {"not", NOT, NOT_NAMES},
+    {"unless", UNLESS, UNLESS_NAMES},
+    {"<=", LESSEQUAL, COMPARISON_NAMES},
+    {">", GREATER, COMPARISON_NAMES},
+    {">=", GREATEREQUAL, COMPARISON_NAMES},
+    {"!=", NOTEQUAL, COMPARISON_NAMES}};
+
+  const PreludeFunction* find_combinator(const ir::Name& name) {
+    if(!name.user_provided()) return NULL;
+    for(unsigned int i = 0; i < sizeof(COMBINATORS) / sizeof(COMBINATORS[0]);
+        ++i)
+      if(name.name() == COMBINATORS[i].user_name) return &COMBINATORS[i];
+    return NULL;
+  }
+
+  bool is_gensym(const ir::Name& name) {
+    return !name.user_provided() && name.name().compare(0,
+        sizeof(GENSYM_PREFIX) - 1, GENSYM_PREFIX) == 0;
+  }
+
+  bool is_literal(ir::Value* value) {
+    return dynamic_cast<ir::Integer*>(value) ||
+        dynamic_cast<ir::Float*>(value) ||
+        dynamic_cast<ir::CharString*>(value) ||
+        dynamic_cast<ir::ByteString*>(value);
+  }
+
+  PTR<ir::Value> copy_literal(ir::Value* value) {
+    if(ir::Integer* val = dynamic_cast<ir::Integer*>(value))
+      return PTR<ir::Value>(new ir::Integer(val->value));
+    if(ir::Float* val = dynamic_cast<ir::Float*>(value))
+      return PTR<ir::Value>(new ir::Float(val->value));
+    if(ir::CharString* val = dynamic_cast<ir::CharString*>(value))
+      return PTR<ir::Value>(new ir::CharString(val->value));
+    ir::ByteString* val(dynamic_cast<ir::ByteString*>(value));
+    return PTR<ir::Value>(new ir::ByteString(val->value));
+  }
+
+  // counts every place a name is read, and notes every way a name gets a
+  // value, across the whole program.
+  class Scanner : public ir::ExpressionVisitor, public ir::ValueVisitor {
+    public:
+      void scan(const std::vector<PTR<ir::Expression> >& exps) {
+        for(unsigned int i = 0; i < exps.size(); ++i) exps[i]->accept(this);
+      }
+
+      void visit(ir::Assignment* assignment) {
+        ++m_assignments[assignment->assignee];
+        const Operator* op(find_operator(assignment->assignee));
+        ir::Variable* var(dynamic_cast<ir::Variable*>(
+            assignment->value.get()));
+        if(op && !(var && var->variable == ir::Name(op->c_name, false)))
+          m_rebound.insert(assignment->assignee);
+        if(!assignment->local) m_rebound.insert(assignment->assignee);
+        assignment->value->accept(this);
+      }
+      void visit(ir::ObjectMutation* mut) {
+        use(mut->object);
+        use(mut->value);
+      }
+      void visit(ir::ReturnValue* rv) {
+        ++m_assignments[rv->assignee];
+        use(rv->term->callable);
+        for(unsigned int i = 0; i < rv->term->left_positional_args.size(); ++i)
+          use(rv->term->left_positional_args[i].variable);
+        if(rv->term->left_arbitrary_arg)
+          use(rv->term->left_arbitrary_arg->variable);
+        for(unsigned int i = 0; i < rv->term->right_positional_args.size();
+            ++i)
+          use(rv->term->right_positional_args[i].variable);
+        for(unsigned int i = 0; i < rv->term->right_optional_args.size(); ++i)
+          use(rv->term->right_optional_args[i].variable);
+        if(rv->term->right_arbitrary_arg)
+          use(rv->term->right_arbitrary_arg->variable);
+        if(rv->term->right_keyword_arg)
+          use(rv->term->right_keyword_arg->variable);
+      }
+
+      void visit(ir::Field* field) { use(field->object); }
+      void visit(ir::Variable* var) { use(var->variable); }
+      void visit(ir::Integer*) {}
+      void visit(ir::CharString*) {}
+      void visit(ir::ByteString*) {}
+      void visit(ir::Float*) {}
+      void visit(ir::Function* func) {
+        for(unsigned int i = 0; i < func->left_positional_args.size(); ++i)
+          bind(func->left_positional_args[i].variable);
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i) {
+          bind(func->left_optional_args[i].variable);
+          use(func->left_optional_args[i].defaultval);
+        }
+        if(func->left_arbitrary_arg) bind(func->left_arbitrary_arg->variable);
+        for(unsigned int i = 0; i < func->right_positional_args.size(); ++i)
+          bind(func->right_positional_args[i].variable);
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i) {
+          bind(func->right_optional_args[i].variable);
+          use(func->right_optional_args[i].defaultval);
+        }
+        if(func->right_arbitrary_arg)
+          bind(func->right_arbitrary_arg->variable);
+        if(func->right_keyword_arg) bind(func->right_keyword_arg->variable);
+        scan(func->expressions);
+        use(func->lastval);
+      }
+
+      std::map<ir::Name, unsigned int> m_uses;
+      std::map<ir::Name, unsigned int> m_assignments;
+      // names that get a value some other way than a single local
+      // assignment, or operators bound to anything but their builtin.
+      std::set<ir::Name> m_rebound;
+
+    private:
+      void use(const ir::Name& name) { ++m_uses[name]; }
+      void bind(const ir::Name& name) { m_rebound.insert(name); }
+  };
+
+  // a folded operand or result.
+  struct Literal {
+    enum Type { INTEGER, FLOAT, STRING } type;
+    long long integer;
+    double floating;
+    std::string string;
+    bool byte_oriented;
+  };
+
+  bool get_literal(ir::Value* value, Literal& lit) {
+    if(ir::Integer* val = dynamic_cast<ir::Integer*>(value)) {
+      lit.type = Literal::INTEGER;
+      lit.integer = val->value;
+    } else if(ir::Float* val = dynamic_cast<ir::Float*>(value)) {
+      lit.type = Literal::FLOAT;
+      lit.floating = val->value;
+    } else if(ir::CharString* val = dynamic_cast<ir::CharString*>(value)) {
+      lit.type = Literal::STRING;
+      lit.string = val->value;
+      lit.byte_oriented = false;
+    } else if(ir::ByteString* val = dynamic_cast<ir::ByteString*>(value)) {
+      lit.type = Literal::STRING;
+      lit.string = val->value;
+      lit.byte_oriented = true;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  double as_double(const Literal& lit) {
+    return lit.type == Literal::INTEGER ? (double)lit.integer : lit.floating;
+  }
+
+  PTR<ir::Value> make_float(double value) {
+    if(!(boost::math::isfinite)(value)) return PTR<ir::Value>();
+    return PTR<ir::Value>(new ir::Float(value));
+  }
+
+  PTR<ir::Value> make_boolean(bool value) {
+    return PTR<ir::Value>(new ir::Variable(ir::Name(value ? "true" : "false",
+        false)));
+  }
+
+  // the runtime compares string bytes as (signed) chars.
+  int compare_strings(const std::string& a, const std::string& b) {
+    std::string::size_type size(std::min(a.size(), b.size()));
+    for(std::string::size_type i = 0; i < size; ++i) {
+      if((signed char)a[i] < (signed char)b[i]) return -1;
+      if((signed char)a[i] > (signed char)b[i]) return 1;
+    }
+    if(a.size() < b.size()) return -1;
+    if(a.size() > b.size()) return 1;
+    return 0;
+  }
+
+  // what builtins.c would compute for a op b. anything that would throw,
+  // overflow, or can't be written back out as a literal isn't folded.
+  PTR<ir::Value> fold(Builtin op, const Literal& a, const Literal& b) {
+    if(a.type == Literal::STRING || b.type == Literal::STRING) {
+      if(a.type != b.type) {
+        if(op == EQUALS) return make_boolean(false);
+        return PTR<ir::Value>();
+      }
+      switch(op) {
+        case ADD:
+          if(a.byte_oriented != b.byte_oriented) return PTR<ir::Value>();
+          if(a.byte_oriented)
+            return PTR<ir::Value>(new ir::ByteString(a.string + b.string));
+          return PTR<ir::Value>(new ir::CharString(a.string + b.string));
+        case EQUALS:
+          return make_boolean(a.byte_oriented == b.byte_oriented &&
+              a.string == b.string);
+        case LESSTHAN:
+          if(a.byte_oriented != b.byte_oriented)
+            return make_boolean(a.byte_oriented < b.byte_oriented);
+          return make_boolean(compare_strings(a.string, b.string) < 0);
+        default:
+          return PTR<ir::Value>();
+      }
+    }
+
+    if(a.type == Literal::INTEGER && b.type == Literal::INTEGER) {
+      long long x(a.integer), y(b.integer);
+      switch(op) {
+        case ADD:
+          if((y > 0 && x > LLONG_MAX - y) || (y < 0 && x < LLONG_MIN - y))
+            return PTR<ir::Value>();
+          return PTR<ir::Value>(new ir::Integer(x + y));
+        case SUBTRACT:
+          if((y < 0 && x > LLONG_MAX + y) || (y > 0 && x < LLONG_MIN + y))
+            return PTR<ir::Value>();
+          return PTR<ir::Value>(new ir::Integer(x - y));
+        case MULTIPLY:
+          if(x > 0 ? (y > 0 ? x > LLONG_MAX / y : y < LLONG_MIN / x) :
+              (y > 0 ? x < LLONG_MIN / y : (x != 0 && y < LLONG_MAX / x)))
+            return PTR<ir::Value>();
+          return PTR<ir::Value>(new ir::Integer(x * y));
+        case DIVIDE:
+          if(y == 0 || (x == LLONG_MIN && y == -1)) return PTR<ir::Value>();
+          if(x % y == 0) return PTR<ir::Value>(new ir::Integer(x / y));
+          return make_float((double)x / y);
+        case MODULO:
+          if(y == 0 || (x == LLONG_MIN && y == -1)) return PTR<ir::Value>();
+          return PTR<ir::Value>(new ir::Integer(x % y));
+        case EQUALS: return make_boolean(x == y);
+        case LESSTHAN: return make_boolean(x < y);
+        default: return PTR<ir::Value>();
+      }
+    }
+
+    double x(as_double(a)), y(as_double(b));
+    switch(op) {
+      case ADD: return make_float(x + y);
+      case SUBTRACT: return make_float(x - y);
+      case MULTIPLY: return make_float(x * y);
+      case DIVIDE: return make_float(x / y);
+      case EQUALS: return make_boolean(x == y);
+      case LESSTHAN: return make_boolean(x < y);
+      default: return PTR<ir::Value>();
+    }
+  }
+
+  class Folder {
+    public:
+      Folder(Scanner& scan, const std::set<std::string>* defined,
+          bool prelude, unsigned long long& varcount)
+        : m_scan(scan), m_defined(defined), m_prelude(prelude),
+          m_varcount(varcount) {}
+
+      void fold_all(std::vector<PTR<ir::Expression> >& exps) {
+        std::vector<PTR<ir::Expression> > out;
+        out.reserve(exps.size());
+        for(unsigned int i = 0; i < exps.size(); ++i) {
+          if(ir::Assignment* assignment = dynamic_cast<ir::Assignment*>(
+              exps[i].get())) {
+            if(ir::Function* func = dynamic_cast<ir::Function*>(
+                assignment->value.get()))
+              fold_all(func->expressions);
+            propagate(assignment);
+          } else if(ir::ReturnValue* rv = dynamic_cast<ir::ReturnValue*>(
+              exps[i].get())) {
+            if(inline_call(rv, out) || specialize(rv, out)) continue;
+            PTR<ir::Value> value(fold_call(rv->term.get()));
+            if(value) {
+              PTR<ir::Assignment> assignment(new ir::Assignment(rv->assignee,
+                  value, true));
+              propagate(assignment.get());
+              out.push_back(assignment);
+              if(single(rv->assignee)) m_plain.insert(rv->assignee);
+              continue;
+            }
+            const Operator* op(find_operator(rv->term->callable));
+            if(op && (op->builtin == EQUALS || op->builtin == LESSTHAN) &&
+                builtin_bound(rv->term->callable, op->user_name) &&
+                rv->term->left_positional_args.size() +
+                rv->term->right_positional_args.size() == 2 &&
+                single(rv->assignee))
+              m_plain.insert(rv->assignee);
+          }
+          out.push_back(exps[i]);
+        }
+        exps.swap(out);
+      }
+
+      // drops literal temporaries nothing reads anymore.
+      void sweep(std::vector<PTR<ir::Expression> >& exps) {
+        std::vector<PTR<ir::Expression> > out;
+        out.reserve(exps.size());
+        for(unsigned int i = 0; i < exps.size(); ++i) {
+          if(ir::Assignment* assignment = dynamic_cast<ir::Assignment*>(
+              exps[i].get())) {
+            if(ir::Function* func = dynamic_cast<ir::Function*>(
+                assignment->value.get()))
+              sweep(func->expressions);
+            if(m_constants.count(assignment->assignee) &&
+                m_scan.m_uses[assignment->assignee] == 0)
+              continue;
+          }
+          out.push_back(exps[i]);
+        }
+        exps.swap(out);
+      }
+
+    private:
+      // a temporary only ever assigned once, locally, can stand in for the
+      // literal it holds.
+      bool single(const ir::Name& name) {
+        return is_gensym(name) && m_scan.m_assignments[name] == 1 &&
+            !m_scan.m_rebound.count(name);
+      }
+
+      void propagate(ir::Assignment* assignment) {
+        if(ir::Variable* var = dynamic_cast<ir::Variable*>(
+            assignment->value.get())) {
+          if(m_plain.count(var->variable) && single(assignment->assignee))
+            m_plain.insert(assignment->assignee);
+          std::map<ir::Name, PTR<ir::Value> >::const_iterator it(
+              m_constants.find(var->variable));
+          if(it == m_constants.end()) return;
+          --m_scan.m_uses[var->variable];
+          assignment->value = copy_literal(it->second.get());
+        }
+        if(is_literal(assignment->value.get()) && single(assignment->assignee))
+          m_constants[assignment->assignee] = assignment->value;
+      }
+
+      bool constant(const ir::Name& name, Literal& lit) {
+        std::map<ir::Name, PTR<ir::Value> >::const_iterator it(
+            m_constants.find(name));
+        return it != m_constants.end() && get_literal(it->second.get(), lit);
+      }
+
+      // whether name still holds what the runtime or prelude bound it to.
+      bool builtin_bound(const ir::Name& name, const char* user_name) {
+        return !m_scan.m_rebound.count(name) && m_defined &&
+            !m_defined->count(user_name);
+      }
+
+      PTR<ir::Value> fold_call(ir::Call* call) {
+        const Operator* op(find_operator(call->callable));
+        if(!op || !builtin_bound(call->callable, op->user_name))
+          return PTR<ir::Value>();
+        if(call->left_arbitrary_arg || !call->right_optional_args.empty() ||
+            call->right_arbitrary_arg || call->right_keyword_arg)
+          return PTR<ir::Value>();
+
+        std::vector<ir::Name> args;
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          args.push_back(call->left_positional_args[i].variable);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          args.push_back(call->right_positional_args[i].variable);
+        if(call->left_positional_args.size() > 1) return PTR<ir::Value>();
+
+        Literal a, b;
+        if(args.size() == 1 && call->left_positional_args.empty() &&
+            op->builtin == SUBTRACT) {
+          // unary minus subtracts from zero.
+          a.type = Literal::INTEGER;
+          a.integer = 0;
+          if(!constant(args[0], b)) return PTR<ir::Value>();
+        } else if(args.size() == 2) {
+          if(!constant(args[0], a) || !constant(args[1], b))
+            return PTR<ir::Value>();
+        } else {
+          return PTR<ir::Value>();
+        }
+
+        PTR<ir::Value> value(fold(op->builtin, a, b));
+        if(value) {
+          --m_scan.m_uses[call->callable];
+          for(unsigned int i = 0; i < args.size(); ++i) --m_scan.m_uses[args[i]];
+        }
+        return value;
+      }
+
+      // a parenthesized subexpression becomes a function with no arguments
+      // that's called right where it's defined. as long as it doesn't
+      // define any names of its own, its body can just go in its place.
+      bool inline_call(ir::ReturnValue* rv,
+          std::vector<PTR<ir::Expression> >& out) {
+        ir::Call* call(rv->term.get());
+        if(out.empty() || !call->left_positional_args.empty() ||
+            call->left_arbitrary_arg || !call->right_positional_args.empty() ||
+            !call->right_optional_args.empty() || call->right_arbitrary_arg ||
+            call->right_keyword_arg)
+          return false;
+        ir::Assignment* def(dynamic_cast<ir::Assignment*>(out.back().get()));
+        if(!def || def->assignee != call->callable ||
+            !single(def->assignee) || m_scan.m_uses[def->assignee] != 1)
+          return false;
+        ir::Function* func(dynamic_cast<ir::Function*>(def->value.get()));
+        if(!func || !func->left_positional_args.empty() ||
+            !func->left_optional_args.empty() || func->left_arbitrary_arg ||
+            !func->right_positional_args.empty() ||
+            !func->right_optional_args.empty() || func->right_arbitrary_arg ||
+            func->right_keyword_arg)
+          return false;
+        for(unsigned int i = 0; i < func->expressions.size(); ++i) {
+          ir::Assignment* assignment(dynamic_cast<ir::Assignment*>(
+              func->expressions[i].get()));
+          if(assignment && assignment->local &&
+              !is_gensym(assignment->assignee))
+            return false;
+        }
+
+        out.pop_back();
+        out.insert(out.end(), func->expressions.begin(),
+            func->expressions.end());
+        PTR<ir::Assignment> result(new ir::Assignment(rv->assignee,
+            PTR<ir::Value>(new ir::Variable(func->lastval)), true));
+        propagate(result.get());
+        out.push_back(result);
+        m_scan.m_uses[def->assignee] = 0;
+        return true;
+      }
+
+      // and and or hand back the first of their arguments that's false (or
+      // true), calling it first if it's a function, or else the last one.
+      // <= and friends are an or or a not of < and ==, and not is an if.
+      // each of them comes out as ifs on blocks that optimize::cps can then
+      // write in place, with the arguments evaluated just as before.
+      bool specialize(ir::ReturnValue* rv,
+          std::vector<PTR<ir::Expression> >& out) {
+        ir::Call* call(rv->term.get());
+        const PreludeFunction* func(find_combinator(call->callable));
+        if(!func || !m_prelude) return false;
+        for(const char* const* name = func->names; *name; ++name) {
+          ir::Name user_name(*name, true);
+          if(m_scan.m_assignments.count(user_name) ||
+              !builtin_bound(user_name, *name))
+            return false;
+        }
+        if(call->left_arbitrary_arg || !call->right_optional_args.empty() ||
+            call->right_arbitrary_arg || call->right_keyword_arg)
+          return false;
+        std::vector<ir::Name> args;
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          args.push_back(call->left_positional_args[i].variable);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          args.push_back(call->right_positional_args[i].variable);
+
+        ir::Name result(NULL_VALUE);
+        switch(func->combinator) {
+          case AND:
+          case OR:
+            result = junction(out, func->combinator == AND, args, 0);
+            break;
+          case NOT:
+            if(!call->left_positional_args.empty() || args.size() != 1)
+              return false;
+            result = negate(out, args[0]);
+            break;
+          case UNLESS:
+            // with a block on just one side, the other is null, and either
+            // way it's the one an if on the test gets for its else.
+            if(call->left_positional_args.size() > 1 || args.size() != 2)
+              return false;
+            {
+              bool left(!call->left_positional_args.empty());
+              result = branch(out, args[left ? 1 : 0],
+                  define(out, block(NULL_VALUE)), args[left ? 0 : 1]);
+            }
+            break;
+          default:
+            if(args.size() != 2) return false;
+            result = compare(out, func->combinator, args[0], args[1]);
+            break;
+        }
+
+        if(func->combinator != AND && func->combinator != OR &&
+            func->combinator != UNLESS)
+          m_plain.insert(result);
+        --m_scan.m_uses[call->callable];
+        PTR<ir::Assignment> assignment(new ir::Assignment(rv->assignee,
+            PTR<ir::Value>(new ir::Variable(result)), true));
+        propagate(assignment.get());
+        out.push_back(assignment);
+        return true;
+      }
+
+      ir::Name junction(std::vector<PTR<ir::Expression> >& out,
+          bool conjunction, const std::vector<ir::Name>& args,
+          unsigned int i) {
+        if(args.empty())
+          return ir::Name(conjunction ? "true" : "false", false);
+        if(i + 1 == args.size()) return args[i];
+        ir::Name ans(demand(out, args[i]));
+        PTR<ir::Function> rest(block(NULL_VALUE));
+        rest->lastval = junction(rest->expressions, conjunction, args, i + 1);
+        if(conjunction) return branch(out, ans, rest, block(ans));
+        return branch(out, ans, block(ans), rest);
+      }
+
+      // demand-thunk: a function gets called for its value.
+      ir::Name demand(std::vector<PTR<ir::Expression> >& out,
+          const ir::Name& arg) {
+        if(m_plain.count(arg) || m_constants.count(arg)) return arg;
+        ir::Name type(apply(out, ir::Name("type", false),
+            std::vector<ir::Name>(1, arg)));
+        ir::Name function(apply(out, ir::Name("equals", false),
+            pair(type, ir::Name("Function", false))));
+        PTR<ir::Function> thunk(block(NULL_VALUE));
+        thunk->lastval = apply(thunk->expressions, arg,
+            std::vector<ir::Name>());
+        return branch(out, function, thunk, block(arg));
+      }
+
+      ir::Name negate(std::vector<PTR<ir::Expression> >& out,
+          const ir::Name& arg) {
+        return branch(out, arg, block(ir::Name("false", false)),
+            block(ir::Name("true", false)));
+      }
+
+      ir::Name compare(std::vector<PTR<ir::Expression> >& out,
+          Combinator combinator, const ir::Name& left,
+          const ir::Name& right) {
+        if(combinator == NOTEQUAL)
+          return negate(out, apply(out, ir::Name("equals", false),
+              pair(left, right)));
+        ir::Name less(apply(out, ir::Name("lessthan", false),
+            pair(left, right)));
+        if(combinator == GREATEREQUAL) return negate(out, less);
+        PTR<ir::Function> equal(block(NULL_VALUE));
+        equal->lastval = apply(equal->expressions, ir::Name("equals", false),
+            pair(left, right));
+        if(combinator == LESSEQUAL)
+          return branch(out, less, block(ir::Name("true", false)), equal);
+        equal->lastval = negate(equal->expressions, equal->lastval);
+        return branch(out, less, block(ir::Name("false", false)), equal);
+      }
+
+      static std::vector<ir::Name> pair(const ir::Name& left,
+          const ir::Name& right) {
+        std::vector<ir::Name> args(1, left);
+        args.push_back(right);
+        return args;
+      }
+
+      ir::Name apply(std::vector<PTR<ir::Expression> >& out,
+          const ir::Name& callable, const std::vector<ir::Name>& args) {
+        PTR<ir::Call> call(new ir::Call(callable));
+        for(unsigned int i = 0; i < args.size(); ++i)
+          call->right_positional_args.push_back(
+              ir::PositionalOutArgument(args[i]));
+        ir::Name result(gensym());
+        out.push_back(PTR<ir::Expression>(new ir::ReturnValue(result, call)));
+        return result;
+      }
+
+      ir::Name branch(std::vector<PTR<ir::Expression> >& out,
+          const ir::Name& test, PTR<ir::Function> then_block,
+          PTR<ir::Function> else_block) {
+        ir::Name then_name(define(out, then_block));
+        return branch(out, test, then_name, define(out, else_block));
+      }
+
+      // an if on blocks that are already in variables.
+      ir::Name branch(std::vector<PTR<ir::Expression> >& out,
+          const ir::Name& test, const ir::Name& then_name,
+          const ir::Name& else_name) {
+        PTR<ir::Call> call(new ir::Call(ir::Name("if", false)));
+        call->right_positional_args.push_back(ir::PositionalOutArgument(test));
+        call->right_positional_args.push_back(
+            ir::PositionalOutArgument(then_name));
+        call->right_positional_args.push_back(
+            ir::PositionalOutArgument(else_name));
+        ir::Name result(gensym());
+        out.push_back(PTR<ir::Expression>(new ir::ReturnValue(result, call)));
+        return result;
+      }
+
+      ir::Name define(std::vector<PTR<ir::Expression> >& out,
+          PTR<ir::Function> func) {
+        ir::Name name(gensym());
+        out.push_back(PTR<ir::Expression>(new ir::Assignment(name, func,
+            true)));
+        return name;
+      }
+
+      PTR<ir::Function> block(const ir::Name& lastval) {
+        return PTR<ir::Function>(new ir::Function(lastval));
+      }
+
+      ir::Name gensym() {
+        std::ostringstream os;
+        os << GENSYM_PREFIX << ++m_varcount;
+        return ir::Name(os.str(), false);
+      }
+
+      Scanner& m_scan;
+      const std::set<std::string>* m_defined;
+      bool m_prelude;
+      unsigned long long& m_varcount;
+      std::map<ir::Name, PTR<ir::Value> > m_constants;
+      // temporaries that can't be holding a function.
+      std::set<ir::Name> m_plain;
+  };
+
+}
+
+void pants::optimize::ir(std::vector<PTR<ir::Expression> >& ir,
+    const std::set<std::string>* defined, bool prelude,
+    unsigned long long& varcount) {
+  Scanner scan;
+  scan.scan(ir);
+  Folder folder(scan, defined, prelude, varcount);
+  folder.fold_all(ir);
+  folder.sweep(ir);
+}
+
+namespace {
+
+  // a continuation that does nothing but hand its value on to the current
+  // function's continuation: k = {|x| continuation(x)}.
+  bool forwards(cps::Callable* k) {
+    if(k->right_positional_args.size() != 1 ||
+        !k->left_positional_args.empty() || !k->left_optional_args.empty() ||
+        k->left_arbitrary_arg || !k->right_optional_args.empty() ||
+        k->right_arbitrary_arg || k->right_keyword_arg)
+      return false;
+    cps::Call* call(dynamic_cast<cps::Call*>(k->expression.get()));
+    return call && call->callable->name == CONTINUATION &&
+        !call->continuation && !call->tail_call &&
+        call->left_positional_args.empty() && !call->left_arbitrary_arg &&
+        call->right_positional_args.size() == 1 &&
+        call->right_positional_args[0]->name ==
+            k->right_positional_args[0]->name &&
+        call->right_optional_args.empty() && !call->right_arbitrary_arg &&
+        !call->right_keyword_arg;
+  }
+
+  // every call gets a continuation of its own from cps::transform, even when
+  // all it does is return. those calls pass their caller's continuation
+  // along instead, which saves making a closure and jumping through it. the
+  // top level is left alone, since images and the prelude hole rely on its
+  // chain ending in a return.
+  class TailCalls : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      TailCalls(bool in_function) : m_inFunction(in_function) {}
+
+      void visit(cps::Call* call) {
+        if(!call->continuation) return;
+        call->continuation->expression->accept(this);
+        if(m_inFunction && forwards(call->continuation.get())) {
+          call->continuation.reset();
+          call->tail_call = true;
+        }
+      }
+      void visit(cps::Assignment* assignment) {
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field*) {}
+      void visit(cps::VariableValue*) {}
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        TailCalls body(true);
+        func->expression->accept(&body);
+      }
+
+    private:
+      bool m_inFunction;
+  };
+
+  // works out which variables can ever be read. reading a field can throw,
+  // but any other value can be made without anything happening, so the
+  // reads in such a value (or anywhere inside a closure) only count when the
+  // variable it's assigned to is live itself.
+  class Liveness : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      Liveness() : m_owner(ROOT) {}
+
+      bool live(unsigned int varid) const {
+        return varid + 1 < m_live.size() && m_live[varid + 1];
+      }
+
+      void visit(cps::Call* call) {
+        read(call->callable);
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          read(call->left_positional_args[i]);
+        read(call->left_arbitrary_arg);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          read(call->right_positional_args[i]);
+        for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+          read(call->right_optional_args[i].value);
+        read(call->right_arbitrary_arg);
+        read(call->right_keyword_arg);
+        if(call->continuation) call->continuation->accept(this);
+        for(unsigned int i = 0; i < call->branches.size(); ++i)
+          call->branches[i]->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        if(pure(assignment->value.get())) {
+          unsigned int owner(m_owner);
+          m_owner = assignment->assignee->getVarid() + 1;
+          assignment->value->accept(this);
+          m_owner = owner;
+        } else {
+          assignment->value->accept(this);
+          read(assignment->assignee);
+        }
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        read(mut->object);
+        read(mut->value);
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field* field) { read(field->object); }
+      void visit(cps::VariableValue* var) { read(var->variable); }
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+          read(func->left_optional_args[i].value);
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+          read(func->right_optional_args[i].value);
+        func->expression->accept(this);
+      }
+
+      static bool pure(cps::Value* value) {
+        return !dynamic_cast<cps::Field*>(value);
+      }
+
+      void solve() {
+        m_live.assign(m_reads.size(), false);
+        m_live[ROOT] = true;
+        std::vector<unsigned int> pending(1, ROOT);
+        while(!pending.empty()) {
+          const std::vector<unsigned int>& reads(m_reads[pending.back()]);
+          pending.pop_back();
+          for(unsigned int i = 0; i < reads.size(); ++i) {
+            if(m_live[reads[i]]) continue;
+            m_live[reads[i]] = true;
+            pending.push_back(reads[i]);
+          }
+        }
+      }
+
+    private:
+      // reads are kept per assigned variable, by varid + 1. the top level
+      // goes in slot 0.
+      enum { ROOT = 0 };
+      void read(const PTR<cps::Variable>& var) {
+        if(!var) return;
+        unsigned int slot(var->getVarid() + 1);
+        if(m_reads.size() <= std::max(slot, m_owner))
+          m_reads.resize(std::max(slot, m_owner) + 1);
+        m_reads[m_owner].push_back(slot);
+      }
+      unsigned int m_owner;
+      std::vector<std::vector<unsigned int> > m_reads;
+      std::vector<bool> m_live;
+  };
+
+  // drops every assignment of a side effect free value to a variable nobody
+  // reads, and with it any closure only that variable could have reached.
+  void sweep(PTR<cps::Expression>* slot, const Liveness& liveness) {
+    while(true) {
+      if(cps::Assignment* assignment = dynamic_cast<cps::Assignment*>(
+          slot->get())) {
+        if(Liveness::pure(assignment->value.get()) &&
+            !liveness.live(assignment->assignee->getVarid())) {
+          *slot = assignment->next_expression;
+          continue;
+        }
+        if(cps::Callable* func = dynamic_cast<cps::Callable*>(
+            assignment->value.get()))
+          sweep(&func->expression, liveness);
+        slot = &assignment->next_expression;
+      } else if(cps::ObjectMutation* mut = dynamic_cast<cps::ObjectMutation*>(
+          slot->get())) {
+        slot = &mut->next_expression;
+      } else {
+        cps::Call* call(dynamic_cast<cps::Call*>(slot->get()));
+        for(unsigned int i = 0; call && i < call->branches.size(); ++i)
+          sweep(&call->branches[i]->expression, liveness);
+        if(call && call->continuation)
+          sweep(&call->continuation->expression, liveness);
+        return;
+      }
+    }
+  }
+
+  // counts the assignments to every variable, how many of those make a new
+  // one, and how many places read it.
+  class Assignments : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      unsigned int total(unsigned int varid) const {
+        return varid < m_total.size() ? m_total[varid] : 0;
+      }
+      unsigned int local(unsigned int varid) const {
+        return varid < m_local.size() ? m_local[varid] : 0;
+      }
+      unsigned int reads(unsigned int varid) const {
+        return varid < m_reads.size() ? m_reads[varid] : 0;
+      }
+
+      void visit(cps::Call* call) {
+        read(call->callable);
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          read(call->left_positional_args[i]);
+        read(call->left_arbitrary_arg);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          read(call->right_positional_args[i]);
+        for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+          read(call->right_optional_args[i].value);
+        read(call->right_arbitrary_arg);
+        read(call->right_keyword_arg);
+        if(call->continuation) call->continuation->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        unsigned int varid(assignment->assignee->getVarid());
+        if(m_total.size() <= varid) {
+          m_total.resize(varid + 1, 0);
+          m_local.resize(varid + 1, 0);
+        }
+        ++m_total[varid];
+        if(assignment->local) ++m_local[varid];
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        read(mut->object);
+        read(mut->value);
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field* field) { read(field->object); }
+      void visit(cps::VariableValue* var) { read(var->variable); }
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+          read(func->left_optional_args[i].value);
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+          read(func->right_optional_args[i].value);
+        func->expression->accept(this);
+      }
+
+    private:
+      void read(const PTR<cps::Variable>& var) {
+        if(!var) return;
+        unsigned int varid(var->getVarid());
+        if(m_reads.size() <= varid) m_reads.resize(varid + 1, 0);
+        ++m_reads[varid];
+      }
+      std::vector<unsigned int> m_total;
+      std::vector<unsigned int> m_local;
+      std::vector<unsigned int> m_reads;
+  };
+
+  // points every call that can only reach one function straight at it. a
+  // variable assigned a function and nothing else always holds it. so does
+  // f in f = {...}, which comes out as a null followed by the function (so
+  // the function can see itself), but only for calls that can't run before
+  // the function is assigned: from inside the function, or further along
+  // the chain it was assigned in. the operators' builtins are followed the
+  // same way, through variables assigned one and nothing else (or a null
+  // first, as in less = <).
+  class KnownCalls : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      KnownCalls(const Assignments& assignments)
+        : m_assignments(assignments) {}
+
+      void visit(cps::Call* call) {
+        unsigned int varid(call->callable->getVarid());
+        if(varid < m_known.size() && m_known[varid])
+          call->target = PTR<cps::Callable>(m_known[varid]);
+        const Operator* op(builtin(varid));
+        if(!op && m_assignments.total(varid) == 0)
+          op = find_builtin(call->callable->name);
+        if(op) call->builtin = op->c_name;
+        if(call->continuation) call->continuation->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        unsigned int varid(assignment->assignee->getVarid());
+        if(assignment->local && m_assignments.total(varid) == 1)
+          bind(varid, assignment->value.get());
+        // a name declared and then given the only value it ever gets right
+        // away is known for everything after the declaration, which is all
+        // the code that can only run once it has that value, and nowhere
+        // else.
+        cps::Value* value(defined_value(assignment));
+        if(value) bind(varid, value);
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+        if(value) forget(varid);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field*) {}
+      void visit(cps::VariableValue*) {}
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) { func->expression->accept(this); }
+
+    private:
+      // the declaration (x = null) of a name, when nothing but the values of
+      // other new locals are worked out before the name is given the one
+      // other value it ever gets (x := v), gives back v, or what v was
+      // assigned if it's one of those locals.
+      cps::Value* defined_value(cps::Assignment* decl) const {
+        cps::VariableValue* null(dynamic_cast<cps::VariableValue*>(
+            decl->value.get()));
+        unsigned int varid(decl->assignee->getVarid());
+        if(!decl->local || !null || null->variable->name != NULL_VALUE ||
+            m_assignments.total(varid) != 2 || m_assignments.local(varid) != 1)
+          return NULL;
+        std::map<unsigned int, cps::Value*> locals;
+        cps::Assignment* next(dynamic_cast<cps::Assignment*>(
+            decl->next_expression.get()));
+        for(; next && next->local; next = dynamic_cast<cps::Assignment*>(
+            next->next_expression.get()))
+          locals[next->assignee->getVarid()] = next->value.get();
+        if(!next || next->assignee->getVarid() != varid) return NULL;
+        cps::VariableValue* var(dynamic_cast<cps::VariableValue*>(
+            next->value.get()));
+        if(var) {
+          std::map<unsigned int, cps::Value*>::iterator it(
+              locals.find(var->variable->getVarid()));
+          if(it != locals.end() &&
+              m_assignments.total(var->variable->getVarid()) == 1)
+            return it->second;
+        }
+        return next->value.get();
+      }
+      // a variable holding a function literal or one of the operators. a
+      // variable only bound once keeps what it holds for the rest of the
+      // walk, since varids are never reused.
+      void bind(unsigned int varid, cps::Value* value) {
+        cps::Callable* func(dynamic_cast<cps::Callable*>(value));
+        if(func && func->function) {
+          if(m_known.size() <= varid) m_known.resize(varid + 1, NULL);
+          m_known[varid] = func;
+        }
+        cps::VariableValue* var(dynamic_cast<cps::VariableValue*>(value));
+        if(var) {
+          unsigned int source(var->variable->getVarid());
+          const Operator* op(builtin(source));
+          if(!op && m_assignments.total(source) == 0)
+            op = find_builtin(var->variable->name);
+          if(op) {
+            if(m_builtins.size() <= varid)
+              m_builtins.resize(varid + 1, NULL);
+            m_builtins[varid] = op;
+          }
+        }
+      }
+      void forget(unsigned int varid) {
+        if(varid < m_known.size()) m_known[varid] = NULL;
+        if(varid < m_builtins.size()) m_builtins[varid] = NULL;
+      }
+      const Operator* builtin(unsigned int varid) const {
+        return varid < m_builtins.size() ? m_builtins[varid] : NULL;
+      }
+      const Assignments& m_assignments;
+      std::vector<cps::Callable*> m_known;
+      std::vector<const Operator*> m_builtins;
+  };
+
+  // the variables a block binds itself, outside of any function it makes,
+  // and whether it reads its own continuation anywhere but to return to it.
+  class BlockLocals : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      BlockLocals() : continuation_read(false) {}
+
+      void visit(cps::Call* call) {
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          read(call->left_positional_args[i]);
+        read(call->left_arbitrary_arg);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          read(call->right_positional_args[i]);
+        for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+          read(call->right_optional_args[i].value);
+        read(call->right_arbitrary_arg);
+        read(call->right_keyword_arg);
+        if(call->continuation) {
+          cps::Callable* k(call->continuation.get());
+          for(unsigned int i = 0; i < k->right_positional_args.size(); ++i)
+            bind(k->right_positional_args[i]);
+          k->expression->accept(this);
+        }
+        for(unsigned int i = 0; i < call->branches.size(); ++i)
+          call->branches[i]->expression->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        if(assignment->local) bind(assignment->assignee);
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        read(mut->object);
+        read(mut->value);
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field* field) { read(field->object); }
+      void visit(cps::VariableValue* var) { read(var->variable); }
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i)
+          read(func->left_optional_args[i].value);
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i)
+          read(func->right_optional_args[i].value);
+      }
+
+      std::map<unsigned int, cps::Name> bound;
+      bool continuation_read;
+
+    private:
+      void bind(const PTR<cps::Variable>& var) {
+        bound.insert(std::make_pair(var->getVarid(), var->name));
+      }
+      void read(const PTR<cps::Variable>& var) {
+        if(var && var->name == CONTINUATION) continuation_read = true;
+      }
+  };
+
+  // gives every variable with one of the given varids its new name.
+  class Rename : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      Rename(const std::map<unsigned int, cps::Name>& names)
+        : m_names(names) {}
+
+      void visit(cps::Call* call) {
+        rename(call->callable);
+        for(unsigned int i = 0; i < call->left_positional_args.size(); ++i)
+          rename(call->left_positional_args[i]);
+        rename(call->left_arbitrary_arg);
+        for(unsigned int i = 0; i < call->right_positional_args.size(); ++i)
+          rename(call->right_positional_args[i]);
+        for(unsigned int i = 0; i < call->right_optional_args.size(); ++i)
+          rename(call->right_optional_args[i].value);
+        rename(call->right_arbitrary_arg);
+        rename(call->right_keyword_arg);
+        if(call->continuation) call->continuation->accept(this);
+        for(unsigned int i = 0; i < call->branches.size(); ++i)
+          call->branches[i]->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        rename(assignment->assignee);
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        rename(mut->object);
+        rename(mut->value);
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field* field) { rename(field->object); }
+      void visit(cps::VariableValue* var) { rename(var->variable); }
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        for(unsigned int i = 0; i < func->left_positional_args.size(); ++i)
+          rename(func->left_positional_args[i]);
+        for(unsigned int i = 0; i < func->left_optional_args.size(); ++i) {
+          rename(func->left_optional_args[i].key);
+          rename(func->left_optional_args[i].value);
+        }
+        rename(func->left_arbitrary_arg);
+        for(unsigned int i = 0; i < func->right_positional_args.size(); ++i)
+          rename(func->right_positional_args[i]);
+        for(unsigned int i = 0; i < func->right_optional_args.size(); ++i) {
+          rename(func->right_optional_args[i].key);
+          rename(func->right_optional_args[i].value);
+        }
+        rename(func->right_arbitrary_arg);
+        rename(func->right_keyword_arg);
+        func->expression->accept(this);
+      }
+
+    private:
+      void rename(const PTR<cps::Variable>& var) {
+        if(!var) return;
+        std::map<unsigned int, cps::Name>::const_iterator it(
+            m_names.find(var->getVarid()));
+        if(it != m_names.end()) var->name = it->second;
+      }
+      const std::map<unsigned int, cps::Name>& m_names;
+  };
+
+  // hands an if or a while its blocks to run in place, when they're
+  // functions without any arguments, made once in the function making the
+  // call and never used anywhere else. they become continuations sharing
+  // that function's frame, so their variables get names no other part of it
+  // uses. a block returns to the if's continuation, which isn't its
+  // function's own unless the if is a tail call, so otherwise it can't read
+  // its continuation. a while's blocks always return into the loop. the
+  // body keeps the variable it was in, as its argument, for the slot its
+  // dynamic variables go in.
+  class Branches : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      Branches(const Assignments& assignments)
+        : m_assignments(assignments), m_function(0), m_functions(1),
+          m_taken(0) {}
+
+      unsigned int taken() const { return m_taken; }
+
+      void visit(cps::Call* call) {
+        if(call->builtin == "if") take_blocks(call);
+        if(call->builtin == "while") take_loop(call);
+        if(call->continuation) call->continuation->expression->accept(this);
+      }
+      void visit(cps::Assignment* assignment) {
+        cps::Callable* func(dynamic_cast<cps::Callable*>(
+            assignment->value.get()));
+        unsigned int varid(assignment->assignee->getVarid());
+        if(func && is_block(func) && assignment->local &&
+            m_assignments.total(varid) == 1 &&
+            m_assignments.reads(varid) == 1) {
+          if(m_blocks.size() <= varid) m_blocks.resize(varid + 1);
+          m_blocks[varid] = Block(func, m_function);
+        }
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field*) {}
+      void visit(cps::VariableValue*) {}
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        unsigned int function(m_function);
+        m_function = m_functions++;
+        func->expression->accept(this);
+        m_function = function;
+      }
+
+    private:
+      struct Block {
+        Block() : func(NULL), function(0) {}
+        Block(cps::Callable* func_, unsigned int function_)
+          : func(func_), function(function_) {}
+        cps::Callable* func;
+        unsigned int function;
+      };
+
+      static bool is_block(cps::Callable* func) {
+        return func->function && func->left_positional_args.empty() &&
+            func->left_optional_args.empty() && !func->left_arbitrary_arg &&
+            func->right_positional_args.empty() &&
+            func->right_optional_args.empty() && !func->right_arbitrary_arg &&
+            !func->right_keyword_arg;
+      }
+
+      // if c {...} {...}, if c {...}, or {...} @if c.
+      void take_blocks(cps::Call* call) {
+        if(call->left_arbitrary_arg || !call->right_optional_args.empty() ||
+            call->right_arbitrary_arg || call->right_keyword_arg)
+          return;
+        std::vector<PTR<cps::Variable> > args;
+        if(call->left_positional_args.empty() &&
+            call->right_positional_args.size() >= 2 &&
+            call->right_positional_args.size() <= 3) {
+          args.assign(call->right_positional_args.begin() + 1,
+              call->right_positional_args.end());
+        } else if(call->left_positional_args.size() == 1 &&
+            call->right_positional_args.size() == 1) {
+          args = call->left_positional_args;
+        } else {
+          return;
+        }
+        std::vector<PTR<cps::Callable> > blocks;
+        if(!find_blocks(args, !call->continuation, blocks)) return;
+        call->left_positional_args.clear();
+        call->right_positional_args.erase(
+            call->right_positional_args.begin() + 1,
+            call->right_positional_args.end());
+        call->branches.swap(blocks);
+        ++m_taken;
+      }
+
+      // while {...} {...}, with somewhere to go once the loop's done.
+      void take_loop(cps::Call* call) {
+        if((!call->continuation && !call->tail_call) ||
+            !call->left_positional_args.empty() || call->left_arbitrary_arg ||
+            call->right_positional_args.size() != 2 ||
+            !call->right_optional_args.empty() || call->right_arbitrary_arg ||
+            call->right_keyword_arg)
+          return;
+        std::vector<PTR<cps::Callable> > blocks;
+        if(!find_blocks(call->right_positional_args, false, blocks)) return;
+        blocks[1]->right_positional_args.push_back(
+            call->right_positional_args[1]);
+        call->right_positional_args.clear();
+        call->branches.swap(blocks);
+        ++m_taken;
+      }
+
+      // the blocks args hold, renamed to run in place, if they all can.
+      bool find_blocks(const std::vector<PTR<cps::Variable> >& args,
+          bool own_continuation, std::vector<PTR<cps::Callable> >& blocks) {
+        std::vector<BlockLocals> locals(args.size());
+        for(unsigned int i = 0; i < args.size(); ++i) {
+          unsigned int varid(args[i]->getVarid());
+          if(varid >= m_blocks.size() || !m_blocks[varid].func ||
+              m_blocks[varid].function != m_function)
+            return false;
+          blocks.push_back(PTR<cps::Callable>(m_blocks[varid].func));
+          blocks[i]->expression->accept(&locals[i]);
+          if(locals[i].continuation_read && !own_continuation) return false;
+        }
+        for(unsigned int i = 0; i < blocks.size(); ++i) {
+          std::map<unsigned int, cps::Name> names;
+          for(std::map<unsigned int, cps::Name>::iterator it(
+              locals[i].bound.begin()); it != locals[i].bound.end(); ++it) {
+            std::ostringstream os;
+            os << "b" << blocks[i]->varid << "_" << it->second.name();
+            names.insert(std::make_pair(it->first, cps::Name(os.str(),
+                false)));
+          }
+          Rename rename(names);
+          blocks[i]->expression->accept(&rename);
+          blocks[i]->function = false;
+        }
+        return true;
+      }
+
+      const Assignments& m_assignments;
+      unsigned int m_function;
+      unsigned int m_functions;
+      unsigned int m_taken;
+      std::vector<Block> m_blocks;
+  };
+
+  // marks the calls to the prelude's break and continue, without any
+  // arguments, that are made right in the body of a while written in place
+  // (or in the test of a loop written in that body), where the loop they
+  // reach is known. only a call that can't reach anything else counts, so
+  // the name has to be the prelude's and hold its function there.
+  class LoopJumps : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      LoopJumps(bool prelude)
+        : m_prelude(prelude), m_inBody(false), m_topLevel(true) {}
+
+      void visit(cps::Call* call) {
+        if(m_inBody && call->target && call->builtin.empty() &&
+            call->left_positional_args.empty() && !call->left_arbitrary_arg &&
+            call->right_positional_args.empty() &&
+            call->right_optional_args.empty() && !call->right_arbitrary_arg &&
+            !call->right_keyword_arg) {
+          std::map<cps::Name, unsigned int>::const_iterator it(
+              m_jumps.find(call->callable->name));
+          if(it != m_jumps.end() && it->second == call->callable->getVarid())
+            call->builtin = it->first.name();
+        }
+        if(call->continuation) call->continuation->expression->accept(this);
+        bool in_body(m_inBody);
+        for(unsigned int i = 0; i < call->branches.size(); ++i) {
+          if(call->builtin == "while" && i == 1) m_inBody = true;
+          call->branches[i]->expression->accept(this);
+        }
+        m_inBody = in_body;
+      }
+      void visit(cps::Assignment* assignment) {
+        // the prelude comes first, so its definitions are the first ones
+        // the top level makes.
+        if(m_prelude && m_topLevel && assignment->local &&
+            (assignment->assignee->name == cps::Name("break", true) ||
+            assignment->assignee->name == cps::Name("continue", true)))
+          m_jumps.insert(std::make_pair(assignment->assignee->name,
+              assignment->assignee->getVarid()));
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field*) {}
+      void visit(cps::VariableValue*) {}
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        bool in_body(m_inBody), top_level(m_topLevel);
+        m_inBody = false;
+        m_topLevel = false;
+        func->expression->accept(this);
+        m_inBody = in_body;
+        m_topLevel = top_level;
+      }
+
+    private:
+      bool m_prelude;
+      bool m_inBody;
+      bool m_topLevel;
+      // the varid of each of the prelude's definitions.
+      std::map<cps::Name, unsigned int> m_jumps;
+  };
+
+  // finds the tail calls a function makes straight back into itself. the
+  // continuation a tail call passes along is its function's own, except in
+  // the branches of an if that has a continuation of its own, and in a
+  // while's, which always go back into the loop.
+  class SelfCalls : public cps::ExpressionVisitor, public cps::ValueVisitor {
+    public:
+      SelfCalls() : m_function(NULL), m_inBranch(false) {}
+
+      void visit(cps::Call* call) {
+        if(call->tail_call && !m_inBranch && m_function &&
+            call->target.get() == m_function && fits(call, m_function)) {
+          call->self_call = true;
+          m_function->self_called = true;
+        }
+        if(call->continuation) call->continuation->expression->accept(this);
+        bool in_branch(m_inBranch);
+        if(call->continuation || call->builtin == "while") m_inBranch = true;
+        for(unsigned int i = 0; i < call->branches.size(); ++i)
+          call->branches[i]->expression->accept(this);
+        m_inBranch = in_branch;
+      }
+      void visit(cps::Assignment* assignment) {
+        assignment->value->accept(this);
+        assignment->next_expression->accept(this);
+      }
+      void visit(cps::ObjectMutation* mut) {
+        mut->next_expression->accept(this);
+      }
+
+      void visit(cps::Field*) {}
+      void visit(cps::VariableValue*) {}
+      void visit(cps::Integer*) {}
+      void visit(cps::String*) {}
+      void visit(cps::Float*) {}
+      void visit(cps::Callable* func) {
+        cps::Callable* function(m_function);
+        bool in_branch(m_inBranch);
+        m_function = func;
+        m_inBranch = false;
+        func->expression->accept(this);
+        m_function = function;
+        m_inBranch = in_branch;
+      }
+
+    private:
+      // positional arguments only, as many on each side as func takes.
+      static bool fits(cps::Call* call, cps::Callable* func) {
+        return call->left_positional_args.size() ==
+            func->left_positional_args.size() && !call->left_arbitrary_arg &&
+            call->right_positional_args.size() ==
+            func->right_positional_args.size() &&
+            call->right_optional_args.empty() && !call->right_arbitrary_arg &&
+            !call->right_keyword_arg && func->left_optional_args.empty() &&
+            !func->left_arbitrary_arg && func->right_optional_args.empty() &&
+            !func->right_arbitrary_arg && !func->right_keyword_arg;
+      }
+
+      cps::Callable* m_function;
+      bool m_inBranch;
+  };
+
 }
 
 void pants::optimize::cps(PTR<cps::Expression>& cps,
-    annotate::DataStore& store) {
+    annotate::DataStore& store, bool prelude) {
+  TailCalls tail_calls(false);
+  cps->accept(&tail_calls);
+
+  Liveness liveness;
+  cps->accept(&liveness);
+  liveness.solve();
+  sweep(&cps, liveness);
+
+  Assignments assignments;
+  cps->accept(&assignments);
+  KnownCalls known_calls(assignments);
+  cps->accept(&known_calls);
+
+  // the blocks an if takes over leave their assignments behind.
+  Branches branches(assignments);
+  cps->accept(&branches);
+  if(branches.taken() > 0) {
+    Liveness blocks_liveness;
+    cps->accept(&blocks_liveness);
+    blocks_liveness.solve();
+    sweep(&cps, blocks_liveness);
+  }
+
+  LoopJumps loop_jumps(prelude);
+  cps->accept(&loop_jumps);
+
+  SelfCalls self_calls;
+  cps->accept(&self_calls);
 }
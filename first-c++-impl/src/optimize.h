@@ -9,8 +9,21 @@
 namespace pants {
 namespace optimize {
 
-  void ir(std::vector<PTR<pants::ir::Expression> >& ir);
-  void cps(PTR<pants::cps::Expression>& cps, pants::annotate::DataStore& store);
+  // propagates literals through the converter's temporaries and folds
+  // arithmetic and comparisons on them. only operators still bound to the
+  // runtime's builtins are folded, so defined has to name every top-level
+  // name that code spliced in ahead of this one (short of the prelude)
+  // defines. NULL means that isn't known, and nothing is folded.
+  // when the program runs after the prelude, calls to the prelude's and, or,
+  // not and comparisons get written out in place too, under the same rule,
+  // with gensyms continuing on from varcount.
+  void ir(std::vector<PTR<pants::ir::Expression> >& ir,
+      const std::set<std::string>* defined, bool prelude,
+      unsigned long long& varcount);
+  // only when the program runs after the prelude do the prelude's break and
+  // continue, called right in a while written in place, become jumps.
+  void cps(PTR<pants::cps::Expression>& cps, pants::annotate::DataStore& store,
+      bool prelude);
 
 }}
 
@@ -0,0 +1,123 @@
+#include "common.h"
+#include "parser.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/time.h>
+
+using namespace pants;
+
+// times the hand-written parser against the original spirit grammar, either
+// on the given source files or on a generated program of roughly the
+// requested size, and checks that both build the same trees.
+
+static const char* CHUNK =
+  "f_%d = {|a, b: %d; c, d: \"x\", :(rest), ::(kw)|\n"
+  "  x = [a, b, c.field, \"str %d\", b\"bytes\", 1.5, -3]\n"
+  "  d = {\"k\": a, %d: {|| b}, x[0]: 2.5e3,}\n"
+  "  if. (a < b) {print(\"less\"); c := rest[0]} {\n"
+  "    z.y := f(a; b, c: d, :(x), ::(d)) # a comment\n"
+  "  }\n"
+  "  while {c <. 10} {c = c + 1; g.h. c}\n"
+  "  @callable. 3 4 .thing\n"
+  "}\n";
+
+static void nest(std::ostringstream& os, unsigned int depth, unsigned int i) {
+  if(depth == 0) {
+    os << "f(" << i << ")";
+    return;
+  }
+  os << "{|x| y = ";
+  nest(os, depth - 1, i);
+  os << "; [x, y]}";
+}
+
+static std::string generate(unsigned long long size, unsigned int depth) {
+  std::ostringstream os;
+  char buf[1024];
+  for(unsigned int i = 0; (unsigned long long)os.tellp() < size; ++i) {
+    snprintf(buf, sizeof(buf), CHUNK, i, i, i, i);
+    os << buf;
+    if(depth > 0) {
+      os << "nested_" << i << " = ";
+      nest(os, depth, i);
+      os << "\n";
+    }
+  }
+  return os.str();
+}
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double time_parse(bool (*parse)(const std::string&,
+    std::vector<PTR<ast::Expression> >&), const std::string& src,
+    std::vector<PTR<ast::Expression> >& ast) {
+  double start = now();
+  if(!parse(src, ast)) throw expectation_failure("failed parsing!");
+  return now() - start;
+}
+
+static void report(const char* name, unsigned long long size, double secs) {
+  printf("%-8s %12llu bytes %10.4f s %10.2f MB/s\n", name, size, secs,
+      size / secs / (1024 * 1024));
+}
+
+int main(int argc, char** argv) {
+  unsigned long long size = 2 * 1024 * 1024;
+  unsigned int depth = 2;
+  std::vector<std::string> files;
+
+  for(int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if(arg.compare(0, 7, "--size=") == 0) {
+      size = strtoull(arg.c_str() + 7, NULL, 10);
+    } else if(arg.compare(0, 8, "--depth=") == 0) {
+      depth = strtoul(arg.c_str() + 8, NULL, 10);
+    } else if(arg == "--help" || arg[0] == '-') {
+      std::cout << "usage: " << argv[0]
+                << " [--size=<bytes>] [--depth=<nesting>] [file ...]"
+                << std::endl;
+      return arg == "--help" ? 0 : 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string> > sources;
+  if(files.empty()) {
+    std::ostringstream name;
+    name << "generated (size " << size << ", depth " << depth << ")";
+    sources.push_back(std::make_pair(name.str(), generate(size, depth)));
+  }
+  for(unsigned int i = 0; i < files.size(); ++i) {
+    std::ifstream in(files[i].c_str());
+    std::ostringstream os;
+    os << in.rdbuf();
+    sources.push_back(std::make_pair(files[i], os.str()));
+  }
+
+  try {
+    for(unsigned int i = 0; i < sources.size(); ++i) {
+      const std::string& src(sources[i].second);
+      std::cout << sources[i].first << ":" << std::endl;
+      std::vector<PTR<ast::Expression> > fast, slow;
+      report("parse", src.size(), time_parse(&parser::parse, src, fast));
+      report("spirit", src.size(), time_parse(&parser::spirit_parse, src,
+          slow));
+      bool same = fast.size() == slow.size();
+      for(unsigned int j = 0; same && j < fast.size(); ++j)
+        same = fast[j]->format() == slow[j]->format();
+      if(!same) throw expectation_failure("parsers disagree!");
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "failure: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,346 +1,538 @@
 #include "parser.h"
-#include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/phoenix.hpp>
+#include <cerrno>
+#include <cfloat>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 namespace pants {
 namespace parser {
 
-  namespace qi = boost::spirit::qi;
-  namespace ascii = boost::spirit::ascii;
-  namespace phx = boost::phoenix;
   using namespace pants::ast;
-  typedef std::string::const_iterator Iterator;
-
-  struct grammar : qi::grammar<Iterator, std::vector<PTR<Expression> >()>{
-    qi::rule<Iterator, std::vector<PTR<Expression> >()> program;
-    qi::rule<Iterator, std::vector<PTR<Expression> >()> explist;
-    qi::rule<Iterator, std::vector<PTR<Expression> >()> nl_explist;
-    qi::rule<Iterator> nl_explistsep;
-    qi::rule<Iterator> definitionsep;
-    qi::rule<Iterator, PTR<Expression>()> expression;
-    qi::rule<Iterator, PTR<Expression>()> mutation;
-    qi::rule<Iterator, PTR<Expression>()> definition;
-    qi::rule<Iterator, PTR<Expression>()> application;
-    qi::rule<Iterator, std::vector<PTR<Term> >()> termlist;
-    qi::rule<Iterator, PTR<Expression>()> nl_expression;
-    qi::rule<Iterator, PTR<Expression>()> nl_mutation;
-    qi::rule<Iterator, PTR<Expression>()> nl_definition;
-    qi::rule<Iterator, PTR<Expression>()> nl_application;
-    qi::rule<Iterator, std::vector<PTR<Term> >()> nl_termlist;
-    qi::rule<Iterator, PTR<Term>()> term;
-    qi::rule<Iterator, PTR<ValueModifier>()> header;
-    qi::rule<Iterator, PTR<ValueModifier>()> trailer;
-    qi::rule<Iterator, PTR<ValueModifier>()> rightopencall;
-    qi::rule<Iterator, PTR<ValueModifier>()> closedcall_right;
-    qi::rule<Iterator, PTR<ValueModifier>()> closedcall_left;
-    qi::rule<Iterator, PTR<ValueModifier>()> index;
-    qi::rule<Iterator, PTR<ValueModifier>()> field;
-    qi::rule<Iterator, PTR<Value>()> value;
-    qi::rule<Iterator, PTR<Value>()> subexpression;
-    qi::rule<Iterator, PTR<Value>()> function;
-    qi::rule<Iterator, PTR<Value>()> valvariable;
-    qi::rule<Iterator, Variable()> variable;
-    qi::rule<Iterator, PTR<Value>()> integer;
-    qi::rule<Iterator, PTR<Value>()> bytestring;
-    qi::rule<Iterator, PTR<Value>()> charstring;
-    qi::rule<Iterator, PTR<Value>()> floating;
-    qi::rule<Iterator, PTR<Value>()> dictionary;
-    qi::rule<Iterator, PTR<Value>()> array;
-    qi::rule<Iterator, std::vector<PTR<Expression> >()> array_elem_list;
-    qi::rule<Iterator, std::vector<DictDefinition>()> dictdefinitionlist;
-    qi::rule<Iterator, DictDefinition()> dictdefinition;
-    qi::rule<Iterator, std::string()> identifier;
-    qi::rule<Iterator, std::string()> charstringvalue;
-    qi::rule<Iterator, std::string()> bytestringvalue;
-    qi::rule<Iterator, InArgList()> inarglist;
-    qi::rule<Iterator, std::vector<PTR<InArgument> >()> inargvec;
-    qi::rule<Iterator, PTR<InArgument>()> in_argument;
-    qi::rule<Iterator, PTR<InArgument>()> required_in_argument;
-    qi::rule<Iterator, PTR<InArgument>()> optional_in_argument;
-    qi::rule<Iterator, PTR<InArgument>()> arbitrary_in_argument;
-    qi::rule<Iterator, PTR<InArgument>()> keyword_in_argument;
-    qi::rule<Iterator, std::vector<PTR<OutArgument> >()> out_arguments;
-    qi::rule<Iterator, PTR<OutArgument>()> out_argument;
-    qi::rule<Iterator, PTR<OutArgument>()> required_out_argument;
-    qi::rule<Iterator, PTR<OutArgument>()> optional_out_argument;
-    qi::rule<Iterator, PTR<OutArgument>()> arbitrary_out_argument;
-    qi::rule<Iterator, PTR<OutArgument>()> keyword_out_argument;
-    qi::rule<Iterator, PTR<Assignee>()> assignee;
-    qi::rule<Iterator> nl_skipper;
-    qi::rule<Iterator> skipper;
-    qi::rule<Iterator> comment;
-
-    grammar() : grammar::base_type(program) {
-#define S(exp) qi::skip(skipper.alias())[exp]
-#define NLS(exp) qi::skip(nl_skipper.alias())[exp]
-
-      char const* exclude = " \n\r\t;,()[]{}|'\".:@#";
-      char const* digits = "0123456789";
-
-      comment = qi::lit("#") >> *(qi::char_ - qi::char_("\n"));
-
-      nl_skipper = qi::char_(" \t\r") | comment;
-      skipper = nl_skipper | '\n';
-
-      program = -nl_explist >> *skipper;
-      program.name("program");
-
-      explist = S(*qi::lit(";") >> expression >> *(+qi::lit(";") >> expression)
-          >> *qi::lit(";"));
-      explist.name("newline-indifferent expression list");
-
-      nl_explistsep = NLS(qi::char_(";\n"));
-      nl_explistsep.name("newline-significant expression list separator");
-
-      nl_explist = NLS(*nl_explistsep >> nl_expression >> *(+nl_explistsep >>
-          nl_expression) >> *nl_explistsep);
-      nl_explist.name("newline-significant expression list");
-
-      expression = definition | mutation | application;
-      expression.name("newline-indifferent expression");
-
-      nl_expression = nl_definition | nl_mutation | nl_application;
-      nl_expression.name("newline-significant expression");
-
-      termlist = S(+term);
-      termlist.name("newline-indifferent application");
-      application = termlist[qi::_val = phx::construct<PTR<Expression> >(
-          phx::new_<Application>(qi::_1))];
-      application.name("newline-indifferent application");
-
-      nl_termlist = NLS(+term);
-      nl_termlist.name("newline-significant application");
-      nl_application = nl_termlist[qi::_val = phx::construct<PTR<Expression> >(
-          phx::new_<Application>(qi::_1))];
-      nl_application.name("newline-significant application");
-
-      definitionsep = qi::lit("=") >> !(qi::char_ - qi::char_(exclude));
-
-      mutation = (S(assignee) >> S(":=" >> expression))[
-          qi::_val = phx::construct<PTR<Expression> >(phx::new_<Mutation>(
-          qi::_1, qi::_2))];
-      mutation.name("newline-indifferent mutation");
-
-      nl_mutation = (NLS(assignee) >> NLS(":=" >> nl_expression))[
-          qi::_val = phx::construct<PTR<Expression> >(phx::new_<Mutation>(
-          qi::_1, qi::_2))];
-      nl_mutation.name("newline-significant mutation");
-
-      definition = (S(assignee) >> S(definitionsep >> expression))[
-          qi::_val = phx::construct<PTR<Expression> >(phx::new_<Definition>(
-          qi::_1, qi::_2))];
-      definition.name("newline-indifferent definition");
-
-      nl_definition = (NLS(assignee) >> NLS(definitionsep >> nl_expression))[
-          qi::_val = phx::construct<PTR<Expression> >(phx::new_<Definition>(
-          qi::_1, qi::_2))];
-      nl_definition.name("newline-significant definition");
-
-      assignee = term[qi::_val = phx::construct<PTR<Assignee> >(
-          phx::new_<Assignee>(qi::_1))];
-      assignee.name("assignee");
-
-      term = (*header >> value >> *trailer)[
-          qi::_val = phx::construct<PTR<Term> >(phx::new_<Term>(qi::_1,
-          qi::_2, qi::_3))];
-      term.name("term");
-
-      trailer = rightopencall | index | field | closedcall_right |
-          closedcall_left;
-      trailer.name("value trailer");
-
-      header = qi::char_("@.")[
-          qi::_val = phx::construct<PTR<ValueModifier> >(
-          phx::new_<OpenCall>())];
-      header.name("open call header");
-
-      identifier = ((qi::char_ - qi::char_(exclude)) - qi::char_(digits)) >>
-          *(qi::char_ - qi::char_(exclude));
-      identifier.name("identifier");
-
-      rightopencall = (qi::char_(".") >> !(
-          qi::char_ - qi::char_(exclude)))[
-          qi::_val = phx::construct<PTR<ValueModifier> >(
-          phx::new_<OpenCall>())];
-      rightopencall.name("open call trailer");
-
-      required_out_argument = application[
-          qi::_val = phx::construct<PTR<OutArgument> >(
-          phx::new_<RequiredOutArgument>(qi::_1))];
-      required_out_argument.name("required out argument");
-
-      optional_out_argument = (S(variable) >> S(":" >> application))[
-          qi::_val = phx::construct<PTR<OutArgument> >(
-          phx::new_<OptionalOutArgument>(qi::_1, qi::_2))];
-      optional_out_argument.name("optional out argument");
-
-      arbitrary_out_argument = (S(qi::lit(":(") >> explist >> ")"))[
-          qi::_val = phx::construct<PTR<OutArgument> >(
-          phx::new_<ArbitraryOutArgument>(qi::_1))];
-      arbitrary_out_argument.name("arbitrary out argument");
-
-      keyword_out_argument = (S(qi::lit("::(") >> explist >> ")"))[
-          qi::_val = phx::construct<PTR<OutArgument> >(
-          phx::new_<KeywordOutArgument>(qi::_1))];
-      keyword_out_argument.name("keyword out argument");
-
-      out_argument = keyword_out_argument
-                   | arbitrary_out_argument
-                   | optional_out_argument
-                   | required_out_argument;
-      out_argument.name("out argument");
-
-      out_arguments = S(*(out_argument >> qi::lit(',')) >> -out_argument);
-      out_arguments.name("out argument list");
-
-      closedcall_right = (qi::lit("(") >> S(out_arguments >> ")"))[qi::_val =
-          phx::construct<PTR<ValueModifier> >(phx::new_<ClosedCall>(qi::_1))];
-      closedcall_right.name("right args closed call trailer");
-
-      closedcall_left = (qi::lit("(") >> S(out_arguments >> ';' >>
-          out_arguments >> ")"))[qi::_val = phx::construct<PTR<ValueModifier> >(
-          phx::new_<ClosedCall>(qi::_1, qi::_2))];
-      closedcall_left.name("left and right args closed call trailer");
-
-      index = (qi::lit("[") >> S(explist >>
-          qi::lit("]")))[qi::_val = phx::construct<PTR<ValueModifier> >(
-          phx::new_<Index>(qi::_1))];
-      index.name("index trailer");
-
-      field = (qi::lit(".") >> variable)[
-          qi::_val = phx::construct<PTR<ValueModifier> >(phx::new_<Field>(
-          qi::_1))];
-      field.name("field trailer");
-
-      value = subexpression
-            | function
-            | bytestring
-            | valvariable
-            | integer
-            | charstring
-            | floating
-            | dictionary
-            | array;
-      value.name("value");
-
-      subexpression = (qi::lit("(") >> S(
-          explist >> ")"))[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<SubExpression>(qi::_1))];
-      subexpression.name("subexpression");
-
-      variable = identifier[phx::bind(&Variable::name, qi::_val) = qi::_1];
-      variable.name("variable");
-
-      valvariable = identifier[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<Variable>(qi::_1))];
-      valvariable.name("variable value");
-
-      integer = (qi::long_long >> !( qi::lit(".") >> qi::char_(digits)))[
-          qi::_val = phx::construct<PTR<Value> >(phx::new_<Integer>(qi::_1))];
-      integer.name("integer");
-
-      floating = qi::double_[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<Float>(qi::_1))];
-      floating.name("floating point number");
-
-      charstringvalue = '"' >> *(qi::char_ - '"') >> '"';
-      charstringvalue.name("character string");
-      charstring = charstringvalue[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<CharString>(qi::_1))];
-      charstring.name("character string");
-
-      bytestringvalue = "b\"" >> *(qi::char_ - '"') >> '"';
-      bytestringvalue.name("byte string");
-      bytestring = bytestringvalue[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<ByteString>(qi::_1))];
-      bytestring.name("byte string");
-
-      dictionary = (qi::lit("{") >> S(
-          dictdefinitionlist >> qi::lit("}")))[
-          qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<Dictionary>(qi::_1))];
-      dictionary.name("dictionary");
-
-      dictdefinitionlist = S(*(dictdefinition >> qi::lit(',')) >>
-          -dictdefinition);
-      dictdefinitionlist.name("dictionary definition list");
-
-      dictdefinition = (S(application) >> S(':' >> application))[phx::bind(
-          &DictDefinition::key, qi::_val) = qi::_1, phx::bind(
-          &DictDefinition::value, qi::_val) = qi::_2];
-      dictdefinition.name("dictionary definition");
-
-      array = (qi::lit("[") >> S(array_elem_list >>
-          qi::lit("]")))[qi::_val = phx::construct<PTR<Value> >(
-          phx::new_<Array>(qi::_1))];
-      array.name("array");
-
-      array_elem_list = S(*(application >> qi::lit(',')) >> -application);
-      array_elem_list.name("array element list");
-
-      function = (qi::lit("{") >> S(-inarglist) >>
-          S(nl_explist >> "}"))[qi::_val =
-          phx::construct<PTR<Value> >(phx::new_<Function>(qi::_1, qi::_2))];
-      function.name("function");
-      inarglist = (S(qi::lit("|") >> -(inargvec >> ";")) >> S(inargvec >> "|"))[
-          phx::bind(&InArgList::left_args, qi::_val) = qi::_1,
-          phx::bind(&InArgList::right_args, qi::_val) = qi::_2];
-      inarglist.name("in argument list");
-
-      inargvec = S(*(in_argument >> ",") >> -in_argument);
-      inargvec.name("in argument list");
-
-      in_argument = keyword_in_argument
-               | arbitrary_in_argument
-               | optional_in_argument
-               | required_in_argument;
-      in_argument.name("in argument");
-
-      required_in_argument = variable[
-          qi::_val = phx::construct<PTR<InArgument> >(
-          phx::new_<RequiredInArgument>(qi::_1))];
-      required_in_argument.name("required in argument");
-
-      optional_in_argument = (S(variable) >> S(":" >> application))[
-          qi::_val = phx::construct<PTR<InArgument> >(
-          phx::new_<OptionalInArgument>(qi::_1, qi::_2))];
-      optional_in_argument.name("optional in argument");
-
-      arbitrary_in_argument = (S(qi::lit(":(") >> variable >> ")"))[
-          qi::_val = phx::construct<PTR<InArgument> >(
-          phx::new_<ArbitraryInArgument>(qi::_1))];
-      arbitrary_in_argument.name("arbitrary in argument");
-
-      keyword_in_argument = (S(qi::lit("::(") >> variable >> ")"))[
-          qi::_val = phx::construct<PTR<InArgument> >(
-          phx::new_<KeywordInArgument>(qi::_1))];
-      keyword_in_argument.name("keyword in argument");
-
-#undef S
-#undef NLS
-
-      qi::on_error<qi::fail>(program,
-        std::cout << phx::val("Error! Expecting ") << qi::_4
-                  << phx::val(" here: \"")
-                  << phx::construct<std::string>(qi::_3, qi::_2)
-                  << phx::val("\"") << std::endl
-      );
-
-    }
+
+  // everything that isn't one of these characters can appear in an
+  // identifier. ' can't appear anywhere outside strings and comments.
+  static const char EXCLUDE[] = " \n\r\t;,()[]{}|'\".:@#";
+
+  // the lexer works directly off the source buffer. the grammar is
+  // whitespace sensitive (a term's trailers have to touch it, newlines only
+  // separate expressions in some contexts), so rather than producing a token
+  // list up front it scans one token at a time wherever the parser asks for
+  // one. nothing ever gets scanned twice outside of the couple of ambiguous
+  // spots the parser has to back out of.
+  class Lexer {
+    public:
+      Lexer(const std::string& src)
+        : m_src(src.data()), m_pos(0), m_end(src.size())
+      {
+        memset(m_excluded, 0, sizeof(m_excluded));
+        for(const char* c = EXCLUDE; *c; ++c)
+          m_excluded[(unsigned char)*c] = true;
+      }
+
+      unsigned long long position() const { return m_pos; }
+      void reset(unsigned long long pos) { m_pos = pos; }
+      bool done() const { return m_pos >= m_end; }
+
+      char peek(unsigned int ahead = 0) const {
+        return m_pos + ahead < m_end ? m_src[m_pos + ahead] : '\0';
+      }
+
+      bool match(char c) {
+        if(peek() != c) return false;
+        ++m_pos;
+        return true;
+      }
+
+      bool match(const char* literal) {
+        unsigned int size = strlen(literal);
+        if(m_end - m_pos < size || memcmp(m_src + m_pos, literal, size) != 0)
+          return false;
+        m_pos += size;
+        return true;
+      }
+
+      // skips spaces and comments, and newlines too if they aren't
+      // significant here.
+      void skip(bool newlines) {
+        while(m_pos < m_end) {
+          char c = m_src[m_pos];
+          if(c == ' ' || c == '\t' || c == '\r' || (newlines && c == '\n')) {
+            ++m_pos;
+          } else if(c == '#') {
+            while(m_pos < m_end && m_src[m_pos] != '\n') ++m_pos;
+          } else {
+            break;
+          }
+        }
+      }
+
+      // the program as a whole is surrounded by any ascii whitespace.
+      void skipSpace() {
+        while(m_pos < m_end && isspace((unsigned char)m_src[m_pos])) ++m_pos;
+      }
+
+      bool excluded(unsigned int ahead = 0) const {
+        return m_pos + ahead >= m_end ||
+            m_excluded[(unsigned char)m_src[m_pos + ahead]];
+      }
+
+      bool digit(unsigned int ahead = 0) const {
+        char c = peek(ahead);
+        return c >= '0' && c <= '9';
+      }
+
+      bool identifierStart(unsigned int ahead = 0) const {
+        return !excluded(ahead) && !digit(ahead);
+      }
+
+      // can a term (and therefore an expression or application) start here?
+      bool termStart() const {
+        switch(peek()) {
+          case '@': case '.': case '(': case '{': case '[': case '"':
+            return true;
+          default:
+            return !excluded();
+        }
+      }
+
+      // "=" is both an identifier and the definition operator. it's only the
+      // latter if it stands alone.
+      bool definitionSeparator() const {
+        return peek() == '=' && excluded(1);
+      }
+
+      bool identifier(std::string& name) {
+        if(!identifierStart()) return false;
+        unsigned long long start = m_pos;
+        while(!excluded()) ++m_pos;
+        name.assign(m_src + start, m_pos - start);
+        return true;
+      }
+
+      // reads up to the closing quote. the opening quote has already been
+      // consumed.
+      bool quoted(std::string& value) {
+        const char* close = (const char*)memchr(m_src + m_pos, '"',
+            m_end - m_pos);
+        if(!close) return false;
+        value.assign(m_src + m_pos, close - (m_src + m_pos));
+        m_pos = close - m_src + 1;
+        return true;
+      }
+
+      // integers are a run of digits not followed by a fractional part.
+      // anything else that starts with a digit, including integers too big
+      // for a long long, is a float.
+      bool number(PTR<Value>& value) {
+        unsigned long long start = m_pos;
+        while(digit()) ++m_pos;
+        if(m_pos == start) return false;
+        if(!(peek() == '.' && digit(1))) {
+          std::string digits(m_src + start, m_pos - start);
+          errno = 0;
+          long long integer = strtoll(digits.c_str(), NULL, 10);
+          if(errno != ERANGE) {
+            value.reset(new Integer(integer));
+            return true;
+          }
+        }
+        match('.');
+        while(digit()) ++m_pos;
+        if(peek() == 'e' || peek() == 'E') {
+          // an exponent that isn't there or doesn't fit in an int isn't part
+          // of the number.
+          unsigned long long exponent = m_pos;
+          m_pos += (peek(1) == '+' || peek(1) == '-') ? 2 : 1;
+          std::string digits;
+          while(digit()) digits += m_src[m_pos++];
+          errno = 0;
+          long parsed = strtol(digits.c_str(), NULL, 10);
+          if(digits.empty() || errno == ERANGE || parsed > INT_MAX)
+            m_pos = exponent;
+        }
+        std::string digits(m_src + start, m_pos - start);
+        double floating = strtod(digits.c_str(), NULL);
+        if(floating > DBL_MAX) return false;
+        value.reset(new Float(floating));
+        return true;
+      }
+
+    private:
+      const char* m_src;
+      unsigned long long m_pos;
+      unsigned long long m_end;
+      bool m_excluded[256];
+  };
+
+  // a predictive recursive descent parser over the same grammar the spirit
+  // version describes. where the spirit grammar tries alternatives that share
+  // a prefix (definition, mutation, application; optional vs required
+  // arguments; right vs left closed calls) the shared prefix is parsed once
+  // and the next character decides. the nl argument picks between the
+  // newline-significant and newline-indifferent flavor of each rule.
+  class Parser {
+    public:
+      Parser(const std::string& src) : m_lexer(src) {}
+
+      bool program(std::vector<PTR<Expression> >& exps) {
+        m_lexer.skipSpace();
+        unsigned long long start = m_lexer.position();
+        if(!expressionList(true, exps)) {
+          exps.clear();
+          m_lexer.reset(start);
+        }
+        m_lexer.skip(true);
+        m_lexer.skipSpace();
+        return m_lexer.done();
+      }
+
+    private:
+      bool separator(bool nl) {
+        return m_lexer.match(';') || (nl && m_lexer.match('\n'));
+      }
+
+      bool expressionList(bool nl, std::vector<PTR<Expression> >& exps) {
+        m_lexer.skip(!nl);
+        while(separator(nl)) m_lexer.skip(!nl);
+        PTR<Expression> exp;
+        if(!m_lexer.termStart() || !expression(nl, exp)) return false;
+        exps.push_back(exp);
+        while(true) {
+          m_lexer.skip(!nl);
+          if(!separator(nl)) return true;
+          do { m_lexer.skip(!nl); } while(separator(nl));
+          if(!m_lexer.termStart()) return true;
+          if(!expression(nl, exp)) return false;
+          exps.push_back(exp);
+        }
+      }
+
+      bool expression(bool nl, PTR<Expression>& exp) {
+        PTR<Term> first;
+        if(!term(first)) return false;
+        unsigned long long after_first = m_lexer.position();
+        m_lexer.skip(!nl);
+        bool definition = m_lexer.definitionSeparator();
+        if(definition ? m_lexer.match('=') : m_lexer.match(":=")) {
+          m_lexer.skip(!nl);
+          PTR<Expression> rhs;
+          if(m_lexer.termStart() && expression(nl, rhs)) {
+            PTR<Assignee> assignee(new Assignee(first));
+            if(definition) exp.reset(new Definition(assignee, rhs));
+            else exp.reset(new Mutation(assignee, rhs));
+            return true;
+          }
+        }
+        // not an assignment after all. "=" is a perfectly good term.
+        m_lexer.reset(after_first);
+        return application(nl, first, exp);
+      }
+
+      bool application(bool nl, PTR<Expression>& exp) {
+        PTR<Term> first;
+        return term(first) && application(nl, first, exp);
+      }
+
+      bool application(bool nl, PTR<Term> first, PTR<Expression>& exp) {
+        std::vector<PTR<Term> > terms;
+        terms.push_back(first);
+        while(true) {
+          unsigned long long before = m_lexer.position();
+          m_lexer.skip(!nl);
+          if(!m_lexer.termStart()) {
+            m_lexer.reset(before);
+            break;
+          }
+          PTR<Term> next;
+          if(!term(next)) return false;
+          terms.push_back(next);
+        }
+        exp.reset(new Application(terms));
+        return true;
+      }
+
+      bool term(PTR<Term>& out) {
+        std::vector<PTR<ValueModifier> > headers;
+        while(m_lexer.match('@') || m_lexer.match('.'))
+          headers.push_back(PTR<ValueModifier>(new OpenCall));
+        PTR<Value> val;
+        if(!value(val)) return false;
+        std::vector<PTR<ValueModifier> > trailers;
+        PTR<ValueModifier> modifier;
+        while(trailer(modifier)) trailers.push_back(modifier);
+        out.reset(new Term(headers, val, trailers));
+        return true;
+      }
+
+      // trailers have to touch the value they modify. a trailer that doesn't
+      // parse leaves the lexer where it started; whatever is there is the
+      // next term.
+      bool trailer(PTR<ValueModifier>& out) {
+        unsigned long long start = m_lexer.position();
+        switch(m_lexer.peek()) {
+          case '.':
+            if(m_lexer.excluded(1)) {
+              m_lexer.match('.');
+              out.reset(new OpenCall);
+              return true;
+            }
+            if(m_lexer.identifierStart(1)) {
+              m_lexer.match('.');
+              Variable var;
+              m_lexer.identifier(var.name);
+              out.reset(new Field(var));
+              return true;
+            }
+            return false;
+          case '[': {
+            m_lexer.match('[');
+            std::vector<PTR<Expression> > exps;
+            if(expressionList(false, exps) && closer(']')) {
+              out.reset(new Index(exps));
+              return true;
+            }
+            break;
+          }
+          case '(':
+            m_lexer.match('(');
+            if(closedCall(out)) return true;
+            break;
+          default:
+            return false;
+        }
+        m_lexer.reset(start);
+        return false;
+      }
+
+      bool closedCall(PTR<ValueModifier>& out) {
+        std::vector<PTR<OutArgument> > right_args;
+        if(!outArguments(right_args)) return false;
+        if(closer(')')) {
+          out.reset(new ClosedCall(right_args));
+          return true;
+        }
+        if(!m_lexer.match(';')) return false;
+        std::vector<PTR<OutArgument> > left_args;
+        left_args.swap(right_args);
+        if(!outArguments(right_args) || !closer(')')) return false;
+        out.reset(new ClosedCall(left_args, right_args));
+        return true;
+      }
+
+      bool closer(char c) {
+        m_lexer.skip(true);
+        return m_lexer.match(c);
+      }
+
+      bool value(PTR<Value>& out) {
+        switch(m_lexer.peek()) {
+          case '(': {
+            m_lexer.match('(');
+            std::vector<PTR<Expression> > exps;
+            if(!expressionList(false, exps) || !closer(')')) return false;
+            out.reset(new SubExpression(exps));
+            return true;
+          }
+          case '{':
+            return functionOrDictionary(out);
+          case '[':
+            return array(out);
+          case '"': {
+            m_lexer.match('"');
+            std::string str;
+            if(!m_lexer.quoted(str)) return false;
+            out.reset(new CharString(str));
+            return true;
+          }
+          case 'b':
+            if(m_lexer.peek(1) == '"') {
+              m_lexer.match("b\"");
+              std::string str;
+              if(!m_lexer.quoted(str)) return false;
+              out.reset(new ByteString(str));
+              return true;
+            }
+            break;
+        }
+        if(m_lexer.digit()) return m_lexer.number(out);
+        std::string name;
+        if(!m_lexer.identifier(name)) return false;
+        out.reset(new Variable(name));
+        return true;
+      }
+
+      bool array(PTR<Value>& out) {
+        m_lexer.match('[');
+        std::vector<PTR<Expression> > values;
+        while(true) {
+          m_lexer.skip(true);
+          if(!m_lexer.termStart()) break;
+          PTR<Expression> exp;
+          if(!application(false, exp)) return false;
+          values.push_back(exp);
+          m_lexer.skip(true);
+          if(!m_lexer.match(',')) break;
+        }
+        if(!closer(']')) return false;
+        out.reset(new Array(values));
+        return true;
+      }
+
+      // a brace starts a function if its contents parse as one, and a
+      // dictionary otherwise. the first expression of a dictionary-looking
+      // function stops parsing at the first colon, so the retry is cheap.
+      bool functionOrDictionary(PTR<Value>& out) {
+        unsigned long long start = m_lexer.position();
+        m_lexer.match('{');
+        m_lexer.skip(true);
+        if(m_lexer.peek() == '|') return function(out);
+        if(m_lexer.peek() != '}' && function(out)) return true;
+        m_lexer.reset(start);
+        return dictionary(out);
+      }
+
+      bool function(PTR<Value>& out) {
+        boost::optional<InArgList> args;
+        if(m_lexer.peek() == '|') {
+          unsigned long long start = m_lexer.position();
+          InArgList list;
+          if(inArgList(list)) {
+            args = list;
+          } else {
+            m_lexer.reset(start);
+          }
+        }
+        m_lexer.skip(true);
+        std::vector<PTR<Expression> > exps;
+        if(!expressionList(true, exps) || !closer('}')) return false;
+        out.reset(new Function(args, exps));
+        return true;
+      }
+
+      bool dictionary(PTR<Value>& out) {
+        m_lexer.match('{');
+        std::vector<DictDefinition> values;
+        while(true) {
+          m_lexer.skip(true);
+          if(!m_lexer.termStart()) break;
+          DictDefinition definition;
+          if(!application(false, definition.key) || !closer(':')) return false;
+          m_lexer.skip(true);
+          if(!m_lexer.termStart() || !application(false, definition.value))
+            return false;
+          values.push_back(definition);
+          m_lexer.skip(true);
+          if(!m_lexer.match(',')) break;
+        }
+        if(!closer('}')) return false;
+        out.reset(new Dictionary(values));
+        return true;
+      }
+
+      bool inArgList(InArgList& list) {
+        m_lexer.match('|');
+        std::vector<PTR<InArgument> > args;
+        if(!inArguments(args)) return false;
+        m_lexer.skip(true);
+        if(m_lexer.match(';')) {
+          list.left_args = args;
+          args.clear();
+          if(!inArguments(args)) return false;
+        }
+        list.right_args = args;
+        return closer('|');
+      }
+
+      bool inArguments(std::vector<PTR<InArgument> >& args) {
+        while(true) {
+          m_lexer.skip(true);
+          if(m_lexer.peek() != ':' && !m_lexer.identifierStart()) return true;
+          PTR<InArgument> arg;
+          if(!inArgument(arg)) return false;
+          args.push_back(arg);
+          m_lexer.skip(true);
+          if(!m_lexer.match(',')) return true;
+        }
+      }
+
+      bool inArgument(PTR<InArgument>& arg) {
+        Variable var;
+        if(m_lexer.match("::(")) {
+          if(!variable(var) || !closer(')')) return false;
+          arg.reset(new KeywordInArgument(var));
+          return true;
+        }
+        if(m_lexer.match(":(")) {
+          if(!variable(var) || !closer(')')) return false;
+          arg.reset(new ArbitraryInArgument(var));
+          return true;
+        }
+        if(!m_lexer.identifier(var.name)) return false;
+        unsigned long long after_name = m_lexer.position();
+        if(closer(':')) {
+          m_lexer.skip(true);
+          PTR<Expression> exp;
+          if(!m_lexer.termStart() || !application(false, exp)) return false;
+          arg.reset(new OptionalInArgument(var, exp));
+          return true;
+        }
+        m_lexer.reset(after_name);
+        arg.reset(new RequiredInArgument(var));
+        return true;
+      }
+
+      bool variable(Variable& var) {
+        m_lexer.skip(true);
+        return m_lexer.identifier(var.name);
+      }
+
+      bool outArguments(std::vector<PTR<OutArgument> >& args) {
+        while(true) {
+          m_lexer.skip(true);
+          if(m_lexer.peek() != ':' && !m_lexer.termStart()) return true;
+          PTR<OutArgument> arg;
+          if(!outArgument(arg)) return false;
+          args.push_back(arg);
+          m_lexer.skip(true);
+          if(!m_lexer.match(',')) return true;
+        }
+      }
+
+      bool outArgument(PTR<OutArgument>& arg) {
+        std::vector<PTR<Expression> > exps;
+        if(m_lexer.match("::(")) {
+          if(!expressionList(false, exps) || !closer(')')) return false;
+          arg.reset(new KeywordOutArgument(exps));
+          return true;
+        }
+        if(m_lexer.match(":(")) {
+          if(!expressionList(false, exps) || !closer(')')) return false;
+          arg.reset(new ArbitraryOutArgument(exps));
+          return true;
+        }
+        unsigned long long start = m_lexer.position();
+        Variable var;
+        PTR<Expression> exp;
+        if(m_lexer.identifier(var.name) && closer(':')) {
+          m_lexer.skip(true);
+          if(!m_lexer.termStart() || !application(false, exp)) return false;
+          arg.reset(new OptionalOutArgument(var, exp));
+          return true;
+        }
+        m_lexer.reset(start);
+        if(!m_lexer.termStart() || !application(false, exp)) return false;
+        arg.reset(new RequiredOutArgument(exp));
+        return true;
+      }
+
+      Lexer m_lexer;
   };
+
 }}
 
 bool pants::parser::parse(const std::string& src,
     std::vector<PTR<pants::ast::Expression> >& ast) {
-  grammar g;
-  std::string::const_iterator iter = src.begin();
-  std::vector<PTR<pants::ast::Expression> > out;
-  bool r = boost::spirit::qi::phrase_parse(iter, src.end(), g, ascii::space,
-      out);
   ast.clear();
-  ast.reserve(out.size());
-  for(unsigned int i = 0; i < out.size(); ++i) {
-    if(out[i]) ast.push_back(out[i]);
-  }
-  return r && iter == src.end();
+  return Parser(src).program(ast);
 }
@@ -10,6 +10,12 @@ namespace parser {
   bool parse(const std::string& src,
       std::vector<PTR<pants::ast::Expression> >& ast);
 
+  // the original boost spirit grammar. parse accepts exactly the same
+  // programs and builds the same trees; this one is only kept around for
+  // parse_bench and the equivalence tests.
+  bool spirit_parse(const std::string& src,
+      std::vector<PTR<pants::ast::Expression> >& ast);
+
 }}
 
 #endif
@@ -1,6 +1,13 @@
 #include "common.h"
 #include "parser.h"
 #include "ir.h"
+#include "cps.h"
+#include "compile.h"
+#include "serialize.h"
+#include "annotate.h"
+#include "module.h"
+#include "optimize.h"
+#include "wrap.h"
 #include <iostream>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/CompilerOutputter.h>
@@ -396,17 +403,26 @@ public:
 class IRTest : public CPPUNIT_NS::TestFixture {
   CPPUNIT_TEST_SUITE(IRTest);
   CPPUNIT_TEST(testSimple);
+  CPPUNIT_TEST(testNames);
+  CPPUNIT_TEST(testFolding);
+  CPPUNIT_TEST(testCombinators);
   CPPUNIT_TEST_SUITE_END();
 
 public:
   void setUp() {}
   void tearDown() {}
-  std::string ir_translate(const std::string& src) {
+  std::string ir_translate(const std::string& src, bool optimize = false) {
     std::vector<PTR<pants::ast::Expression> > ast;
     CPPUNIT_ASSERT(pants::parser::parse(src, ast));
     std::vector<PTR<pants::ir::Expression> > ir;
     pants::ir::Name lastval(NULL_VALUE);
-    pants::ir::convert(ast, ir, lastval);
+    unsigned long long varcount = 0;
+    pants::ir::convert(ast, ir, lastval, varcount);
+    if(optimize) {
+      lastval = NULL_VALUE;
+      std::set<std::string> defined;
+      pants::optimize::ir(ir, &defined, true, varcount);
+    }
     std::ostringstream out;
     for(unsigned int i = 0; i < ir.size(); ++i)
       out << ir[i]->format(0) << std::endl;
@@ -445,10 +461,792 @@ public:
         "c_ir_1");
     CPPUNIT_ASSERT_THROW(ir_translate(".x := 3\n"), pants::expectation_failure);
   }
+
+  void testNames() {
+    pants::ir::Name a("some-name", true), b("some-name", true);
+    pants::ir::Name c("some-name", false);
+    CPPUNIT_ASSERT(a == b);
+    CPPUNIT_ASSERT(a.id() == b.id());
+    CPPUNIT_ASSERT(a != c);
+    CPPUNIT_ASSERT(&a.c_name() == &b.c_name());
+    CPPUNIT_ASSERT(a.c_name() == "u_some_2dname");
+    CPPUNIT_ASSERT(c.c_name() == "c_some_2dname");
+    CPPUNIT_ASSERT(a.name() == "some-name" && !c.user_provided());
+    CPPUNIT_ASSERT(c.format() == "c_some-name");
+  }
+
+  void testFolding() {
+    CPPUNIT_ASSERT(ir_translate("x = (1 +. 2) *. 3\n", true) ==
+        "Assignment(local, u_x, Variable(c_null))\n"
+        "Assignment(nonlocal, u_x, Integer(9))\n"
+        "c_null");
+    CPPUNIT_ASSERT(ir_translate("x = (\"a\" +. \"b\") ==. \"ab\"\n", true) ==
+        "Assignment(local, u_x, Variable(c_null))\n"
+        "Assignment(local, c_ir_9, Variable(c_true))\n"
+        "Assignment(nonlocal, u_x, Variable(c_ir_9))\n"
+        "c_null");
+    // nothing that would throw or overflow at runtime gets folded.
+    CPPUNIT_ASSERT(ir_translate("x = 1 /. 0\n", true).find(
+        "Call(u_/") != std::string::npos);
+    CPPUNIT_ASSERT(ir_translate("x = 9223372036854775807 +. 1\n", true).find(
+        "Call(u_+") != std::string::npos);
+    // neither does an operator that's been rebound.
+    CPPUNIT_ASSERT(ir_translate("+ = {0}\nx = 1 +. 2\n", true).find(
+        "Call(u_+") != std::string::npos);
+  }
+
+  void testCombinators() {
+    // the comparison's result can't be a function, so only y gets checked.
+    std::string ir(ir_translate("x = and (< 1 2) y (>= 3 4)\n", true));
+    CPPUNIT_ASSERT(ir.find("Call(u_and") == std::string::npos);
+    CPPUNIT_ASSERT(ir.find("Call(c_lessthan") != std::string::npos);
+    CPPUNIT_ASSERT(ir.find("Call(c_type") != std::string::npos);
+    CPPUNIT_ASSERT(ir.find("Call(c_type") == ir.rfind("Call(c_type"));
+    CPPUNIT_ASSERT(ir.find("Call(c_if") != std::string::npos);
+    // a call with the wrong number of arguments, or to a name the program
+    // binds itself, is left alone.
+    CPPUNIT_ASSERT(ir_translate("x = <= 1 2 3\n", true).find(
+        "Call(u_<=") != std::string::npos);
+    CPPUNIT_ASSERT(ir_translate("not = {|a| a}\nx = not 1\n", true).find(
+        "Call(u_not") != std::string::npos);
+    // and so is one whose prelude definition looks up something the program
+    // binds.
+    CPPUNIT_ASSERT(ir_translate("== := {|a, b| true}\nx = != 1 2\n",
+        true).find("Call(u_!=") != std::string::npos);
+    CPPUNIT_ASSERT(ir_translate("< := {|a, b| true}\nx = > 1 2\n",
+        true).find("Call(u_>") != std::string::npos);
+    // unless with a block on one side is an if with that block for its else.
+    ir = ir_translate("x = unless y z\nw = z @unless y\n", true);
+    CPPUNIT_ASSERT(ir.find("Call(u_unless") == std::string::npos);
+    CPPUNIT_ASSERT(ir.find("Call(c_if") != ir.rfind("Call(c_if"));
+  }
+};
+
+class ParserEquivalenceTest : public CPPUNIT_NS::TestFixture {
+  CPPUNIT_TEST_SUITE(ParserEquivalenceTest);
+  CPPUNIT_TEST(testEquivalence);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+  std::string result(bool (*parse)(const std::string&,
+      std::vector<PTR<pants::ast::Expression> >&), const std::string& src) {
+    std::vector<PTR<pants::ast::Expression> > exps;
+    try {
+      if(!parse(src, exps)) return "failed";
+    } catch (const std::exception& e) {
+      return std::string("exception: ") + e.what();
+    }
+    std::ostringstream os;
+    for(unsigned int i = 0; i < exps.size(); ++i)
+      os << exps[i]->format() << "\n";
+    return os.str();
+  }
+
+  void testEquivalence() {
+    // every source from ParserTest, plus the corners of the grammar where
+    // the spirit version has to backtrack.
+    const char* sources[] = {
+    "hey. there",
+    "call. thing [value]",
+    "call. thing[key]",
+    "call. thing1. notafield",
+    "call. thing1.afield",
+    "call. function..afield",
+    "call. function..afuncfield.",
+    "f(arg)",
+    "f(arg1, arg2)",
+    "f (arg)",
+    "f.(arg)",
+    "f. (arg)",
+    "f(arg1;arg2)",
+    "f(arg1,arg2;arg3)",
+    "f(arg1,arg2,;arg3)",
+    "[z,]",
+    "{test1:test2,}",
+    "f(arg1,)",
+    "{|a,;| null}",
+    "{|b,| null}",
+    "{}",
+    "{|| thing:thing}",
+    "{thing1:thing2}",
+    "{null}",
+    "{{thing1:thing2}}",
+    "{|a| print(\"hi\"); null}",
+    "{|a,| null}",
+    "{|a,b| 0}",
+    "{|a,b,| 0}",
+    "{|a,b,c:3| 0}",
+    "{|a,b,c:3,d:4| 0}",
+    "{|a,b,c:3,d:4,:(opt)| 0}",
+    "{|a,b,c:3,d:4,q(opt)| 0}",
+    "{|| 0}",
+    "{|;| 0}",
+    "{|a;| 0}",
+    "{|a,b;| 0}",
+    "{|a,b,;| 0}",
+    "{|:(var),a,b,;| 0}",
+    "{|:(var),a,b,d;e,f,g:5,h:7,:(j)| 0}",
+    "{|:(a);:(b)| 0}",
+    "{|;::(b)| 0}",
+    "f(thing, :(thing))",
+    "f(*,(thing),thing)",
+    "f. b\"thing\"",
+    "f. b \"thing\"",
+    "f. b\"\"",
+    "f. b \"\"",
+    "x := 1",
+    "(a b).thing",
+    "(a b).thing := 3",
+    "z.thing := 3; x[4] := 5",
+    "f; f",
+    "f\nf",
+    "hey there; how are you; ",
+    "hey there\nhow are you\n",
+    "(f\nf)",
+    "(f;f)",
+    "x = 3\n",
+    "x = 3.0\n",
+    "x <. 3\n",
+    "x ==. 3\n",
+    "# ||||| this comment shouldn't fail { \n 1\n",
+    "# ||||| this comment shouldn't fail { \n # ||||| this comment shouldn't fail { \n 1\n",
+    "\n   1 # ||||| this comment shouldn't fail { \n # ||||| this comment shouldn't fail { \n \n",
+    "\n   1 # ||||| this comment shouldn't fail { \n 2 # ||||| this comment shouldn't fail { \n \n",
+    "a =b",
+    "a b = c",
+    "a =\nb",
+    "a =(b, c)",
+    "a =()",
+    "a =. b",
+    "a[]",
+    "a[1, 2]",
+    "f(a; b; c)",
+    "f()",
+    "f(a:=b)",
+    "x :=5",
+    "x :=\ny",
+    "{a\nb: c}",
+    "{a := b}",
+    "{a\n: b}",
+    "{;}",
+    "{a: 1, b: {c: 2},}",
+    "{{{a: 1}: 2}: 3}",
+    "1e5",
+    "1.5e+3x 2.5e",
+    "99999999999999999999",
+    "f.1",
+    "1. x",
+    ".5",
+    "1..x",
+    "a.b\"x\"",
+    "f(::(x); y)",
+    "@f. 3 @.g",
+    "\'",
+    "\"unterminated",
+    ";",
+    "  # only a comment\n",
+    "",
+    "x = {|a: 1 2, ::(k)| a}\n",
+    "(a; b;)",
+    "f(a :(b))",
+    "f(a ::(b))",
+    "f(b\"x\": 1)",
+    "a\n\n;;\nb;",
+    "x(1)(2)[3].y.(z)",
+    "{|a| \n}",
+    "{|a b| c}",
+    "[a\nb, c]",
+    "f(\na,\nb\n)"};
+    for(unsigned int i = 0; i < sizeof(sources) / sizeof(*sources); ++i) {
+      CPPUNIT_ASSERT_EQUAL(result(&pants::parser::spirit_parse, sources[i]),
+          result(&pants::parser::parse, sources[i]));
+    }
+  }
+};
+
+class CPSImageTest : public CPPUNIT_NS::TestFixture {
+  CPPUNIT_TEST_SUITE(CPSImageTest);
+  CPPUNIT_TEST(testSplice);
+  CPPUNIT_TEST(testCorruption);
+  CPPUNIT_TEST(testRelocation);
+  CPPUNIT_TEST(testModuleInfo);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+  PTR<pants::cps::Expression> cps_translate(const std::string& src,
+      unsigned long long& varcount) {
+    std::vector<PTR<pants::ast::Expression> > ast;
+    CPPUNIT_ASSERT(pants::parser::parse(src, ast));
+    std::vector<PTR<pants::ir::Expression> > ir;
+    pants::ir::Name lastval(NULL_VALUE);
+    pants::ir::convert(ast, ir, lastval, varcount);
+    PTR<pants::cps::Expression> cps;
+    pants::cps::transform(ir, NULL_VALUE, cps);
+    return cps;
+  }
+
+  std::string image(const std::string& src) {
+    unsigned long long varcount = 0;
+    std::ostringstream os;
+    PTR<pants::cps::Expression> cps(cps_translate(src, varcount));
+    pants::serialize::write_cps(cps, varcount, os);
+    return os.str();
+  }
+
+  void testSplice() {
+    std::string prelude("f = {|a, b:3; c, d:\"x\", :(e), ::(g)| a.h := c; b}\n"
+        "y = 1.5; z = b\"bytes\"\nf(1; 2, d: y)\n");
+    std::string program("q = f.h\nf(:(y); ::(z))\n");
+
+    unsigned long long expected_varcount = 0;
+    std::string expected(cps_translate(prelude + program,
+        expected_varcount)->format(0));
+
+    std::string data(image(prelude));
+    PTR<pants::cps::Expression> cps;
+    PTR<pants::cps::Expression>* hole = NULL;
+    unsigned long long varcount = 0;
+    pants::serialize::read_cps(data.data(), data.size(), cps, hole, varcount);
+    CPPUNIT_ASSERT(hole);
+    *hole = cps_translate(program, varcount);
+    CPPUNIT_ASSERT(cps->format(0) == expected);
+  }
+
+  void testCorruption() {
+    std::string data(image("x = 1\n"));
+    PTR<pants::cps::Expression> cps;
+    PTR<pants::cps::Expression>* hole = NULL;
+    unsigned long long varcount = 0;
+    CPPUNIT_ASSERT_THROW(pants::serialize::read_cps(data.data(),
+        data.size() - 1, cps, hole, varcount), pants::expectation_failure);
+    CPPUNIT_ASSERT_THROW(pants::serialize::read_cps(data.data() + 1,
+        data.size() - 1, cps, hole, varcount), pants::expectation_failure);
+  }
+
+  void testRelocation() {
+    unsigned long long expected_varcount = 0;
+    cps_translate("f = {|a| a}\nf(1)\n", expected_varcount);
+    std::string data(image("f = {|a| a}\nf(1)\n"));
+
+    PTR<pants::cps::Expression> first, second;
+    PTR<pants::cps::Expression>* hole = NULL;
+    unsigned long long varcount = 0;
+    pants::serialize::read_cps(data.data(), data.size(), first, hole,
+        varcount);
+    CPPUNIT_ASSERT(varcount == expected_varcount);
+    unsigned long long base(varcount);
+    pants::serialize::read_cps(data.data(), data.size(), second, hole,
+        varcount);
+    CPPUNIT_ASSERT(varcount == base + expected_varcount);
+    unsigned long long tail_varcount(varcount);
+    *hole = cps_translate("null\n", tail_varcount);
+
+    // the same image loaded again gets its own gensyms.
+    PTR<pants::cps::Expression> fresh;
+    unsigned long long fresh_varcount = 0;
+    pants::serialize::read_cps(data.data(), data.size(), fresh, hole,
+        fresh_varcount);
+    tail_varcount = varcount;
+    *hole = cps_translate("null\n", tail_varcount);
+    CPPUNIT_ASSERT(second->format(0) != fresh->format(0));
+  }
+
+  void testModuleInfo() {
+    pants::serialize::ModuleInfo info;
+    info.imports.push_back("a.p");
+    info.exports.push_back("x");
+    info.fingerprint = "compiler";
+    unsigned long long varcount = 0;
+    std::ostringstream os;
+    pants::serialize::write_cps(cps_translate("x = 1\n", varcount),
+        varcount, os, info);
+    std::string data(os.str());
+
+    pants::serialize::ModuleInfo read;
+    PTR<pants::cps::Expression> cps;
+    PTR<pants::cps::Expression>* hole = NULL;
+    varcount = 0;
+    pants::serialize::read_cps(data.data(), data.size(), cps, hole, varcount,
+        &read);
+    CPPUNIT_ASSERT(read.imports == info.imports);
+    CPPUNIT_ASSERT(read.exports == info.exports);
+    CPPUNIT_ASSERT(read.fingerprint == "compiler");
+  }
+};
+
+class AnnotateTest : public CPPUNIT_NS::TestFixture {
+  CPPUNIT_TEST_SUITE(AnnotateTest);
+  CPPUNIT_TEST(testNames);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+  void testNames() {
+    std::vector<PTR<pants::ast::Expression> > ast;
+    CPPUNIT_ASSERT(pants::parser::parse("f = {|a| g = {|b| a(b)}; g(c)}\n"
+        "f(d)\n", ast));
+    std::vector<PTR<pants::ir::Expression> > ir;
+    pants::ir::Name lastval(NULL_VALUE);
+    pants::ir::convert(ast, ir, lastval);
+    PTR<pants::cps::Expression> cps;
+    pants::cps::transform(ir, lastval, cps);
+    pants::annotate::DataStore store;
+    pants::annotate::names(cps, store);
+
+    std::set<pants::cps::Callable*> seen;
+    std::vector<PTR<pants::cps::Callable> > functions;
+    for(unsigned int i = 0; i < store.callables().size(); ++i) {
+      CPPUNIT_ASSERT(seen.insert(store.callables()[i].get()).second);
+      if(store.callables()[i]->function)
+        functions.push_back(store.callables()[i]);
+    }
+    CPPUNIT_ASSERT(functions.size() == 2);
+    std::set<pants::cps::Name> free_names(functions[0]->getFreeNames());
+    CPPUNIT_ASSERT(free_names.count(pants::cps::Name("c", true)) == 1);
+    CPPUNIT_ASSERT(free_names.count(pants::cps::Name("a", true)) == 0);
+    CPPUNIT_ASSERT(free_names.count(pants::cps::Name("g", true)) == 0);
+    CPPUNIT_ASSERT(functions[0]->getFrameNames().count(
+        pants::cps::Name("g", true)) == 1);
+    CPPUNIT_ASSERT(functions[1]->getFreeNames().count(
+        pants::cps::Name("a", true)) == 1);
+    CPPUNIT_ASSERT(store.freeNames().count(pants::cps::Name("d", true)) == 1);
+    CPPUNIT_ASSERT(store.frameNames().count(pants::cps::Name("f", true)) == 1);
+  }
+};
+
+class ModuleTest : public CPPUNIT_NS::TestFixture {
+  CPPUNIT_TEST_SUITE(ModuleTest);
+  CPPUNIT_TEST(testImports);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+  void testImports() {
+    std::vector<PTR<pants::ast::Expression> > ast;
+    CPPUNIT_ASSERT(pants::parser::parse("import \"a.p\"\nx = 1\n"
+        "import(\"b.p\")\nimports(\"c.p\")\n", ast));
+    std::vector<std::string> paths;
+    pants::module::imports(ast, paths);
+    CPPUNIT_ASSERT(paths.size() == 2);
+    CPPUNIT_ASSERT(paths[0] == "a.p" && paths[1] == "b.p");
+    CPPUNIT_ASSERT(ast.size() == 2);
+
+    ast.clear();
+    CPPUNIT_ASSERT(pants::parser::parse("import x\n", ast));
+    CPPUNIT_ASSERT_THROW(pants::module::imports(ast, paths),
+        pants::expectation_failure);
+  }
+};
+
+class OptimizeTest : public CPPUNIT_NS::TestFixture {
+  CPPUNIT_TEST_SUITE(OptimizeTest);
+  CPPUNIT_TEST(testTailCalls);
+  CPPUNIT_TEST(testDeadBindings);
+  CPPUNIT_TEST(testKnownCalls);
+  CPPUNIT_TEST(testBuiltinCalls);
+  CPPUNIT_TEST(testTypes);
+  CPPUNIT_TEST(testFrameEscapes);
+  CPPUNIT_TEST(testEnvironments);
+  CPPUNIT_TEST(testBoxing);
+  CPPUNIT_TEST(testBranches);
+  CPPUNIT_TEST(testLoops);
+  CPPUNIT_TEST(testSelfCalls);
+  CPPUNIT_TEST(testKeywordSlots);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+  PTR<pants::cps::Expression> optimize(const std::string& src,
+      pants::annotate::DataStore& store, bool prelude = false) {
+    std::vector<PTR<pants::ast::Expression> > ast;
+    CPPUNIT_ASSERT(pants::parser::parse(src, ast));
+    std::vector<PTR<pants::ir::Expression> > ir;
+    pants::wrap::ir_prepend(ir);
+    pants::ir::Name lastval(NULL_VALUE);
+    pants::ir::convert(ast, ir, lastval);
+    PTR<pants::cps::Expression> cps;
+    pants::cps::transform(ir, lastval, cps);
+    pants::annotate::varids(cps, store);
+    pants::optimize::cps(cps, store, prelude);
+    pants::annotate::types(cps, store);
+    pants::annotate::names(cps, store);
+    return cps;
+  }
+
+  pants::cps::Call* first_call(PTR<pants::cps::Expression> cps) {
+    pants::cps::Assignment* assignment;
+    while((assignment = dynamic_cast<pants::cps::Assignment*>(cps.get())))
+      cps = assignment->next_expression;
+    return dynamic_cast<pants::cps::Call*>(cps.get());
+  }
+
+  void testTailCalls() {
+    pants::annotate::DataStore store;
+    PTR<pants::cps::Expression> cps(optimize(
+        "h = {|z| z}\ng = {|y| h(y); y}\nf = {|x| g(x)}\nf(1)\n", store));
+    std::vector<pants::cps::Call*> calls;
+    for(unsigned int i = 0; i < store.callables().size(); ++i) {
+      pants::cps::Callable* func(store.callables()[i].get());
+      if(!func->function) continue;
+      calls.push_back(first_call(func->expression));
+    }
+    CPPUNIT_ASSERT(calls.size() == 3);
+    // f returns whatever g does, but g has more to do after calling h.
+    CPPUNIT_ASSERT(calls[0] && calls[0]->tail_call && !calls[0]->continuation);
+    CPPUNIT_ASSERT(calls[1] && !calls[1]->tail_call && calls[1]->continuation);
+    // the top level always keeps its continuations.
+    pants::cps::Call* call(first_call(cps));
+    CPPUNIT_ASSERT(call && !call->tail_call && call->continuation);
+  }
+
+  void testDeadBindings() {
+    pants::annotate::DataStore store;
+    std::string cps(optimize("f = {|a| a}\nunused = {|b| f(b)}\nkept = f\n"
+        "field = f.x\nloop = {|c| loop(c)}\nf(1)\n", store)->format(0));
+    CPPUNIT_ASSERT(cps.find("u_f") != std::string::npos);
+    CPPUNIT_ASSERT(cps.find("u_unused") == std::string::npos);
+    CPPUNIT_ASSERT(cps.find("u_kept") == std::string::npos);
+    CPPUNIT_ASSERT(cps.find("u_loop") == std::string::npos);
+    // looking up a field can throw, so it stays.
+    CPPUNIT_ASSERT(cps.find("Field(u_f, u_x)") != std::string::npos);
+  }
+
+  pants::cps::Callable* function_of(pants::annotate::DataStore& store,
+      const std::string& arg) {
+    for(unsigned int i = 0; i < store.callables().size(); ++i) {
+      pants::cps::Callable* func(store.callables()[i].get());
+      if(func->function && func->right_positional_args.size() == 1 &&
+          func->right_positional_args[0]->name.name() == arg)
+        return func;
+    }
+    return NULL;
+  }
+
+  void testKnownCalls() {
+    pants::annotate::DataStore store;
+    PTR<pants::cps::Expression> cps(optimize(
+        "h = {|c| c}\ng = {|b| h(b)}\nf = {|a| f(a)}\nf(g(1))\n", store));
+    pants::cps::Callable* f(function_of(store, "a"));
+    pants::cps::Callable* g(function_of(store, "b"));
+    pants::cps::Callable* h(function_of(store, "c"));
+    CPPUNIT_ASSERT(f && g && h);
+    // f can call itself, and g can only run once h is defined.
+    pants::cps::Call* call(first_call(f->expression));
+    CPPUNIT_ASSERT(call && call->target.get() == f);
+    call = first_call(g->expression);
+    CPPUNIT_ASSERT(call && call->target.get() == h);
+    call = first_call(cps);
+    CPPUNIT_ASSERT(call && call->target.get() == g);
+    call = first_call(call->continuation->expression);
+    CPPUNIT_ASSERT(call && call->target.get() == f);
+
+    // h is reassigned after g is made, so g could find anything in it.
+    pants::annotate::DataStore store2;
+    optimize("h = 0\ng = {|b| h(b)}\nh := {|c| c}\ng(1)\n", store2);
+    call = first_call(function_of(store2, "b")->expression);
+    CPPUNIT_ASSERT(call && !call->target);
+
+    // a function given to a name in a block that might never run, or only
+    // runs later, says nothing about calls that don't come after it.
+    const char* later[] = {"if false {println := {|z| z}}\n",
+        "f = {println := {|z| z}}\n"};
+    for(unsigned int i = 0; i < 2; ++i) {
+      pants::annotate::DataStore store3;
+      optimize(std::string(later[i]) + "g = {|y| println(y)}\ng(1)\n", store3);
+      call = first_call(function_of(store3, "y")->expression);
+      CPPUNIT_ASSERT(call && !call->target);
+    }
+  }
+
+  void testBuiltinCalls() {
+    pants::annotate::DataStore store;
+    optimize("less = <\nf = {|a| less(a, 1)}\ng = {|b| b +. 1}\nf(g(1))\n",
+        store);
+    pants::cps::Call* call(first_call(function_of(store, "a")->expression));
+    CPPUNIT_ASSERT(call && call->builtin == "lessthan");
+    call = first_call(function_of(store, "b")->expression);
+    CPPUNIT_ASSERT(call && call->builtin == "add");
+
+    // a rebound operator is just another function.
+    pants::annotate::DataStore store2;
+    optimize("+ = {|x; y| x}\ng = {|b| b +. 1}\ng(1)\n", store2);
+    call = first_call(function_of(store2, "b")->expression);
+    CPPUNIT_ASSERT(call && call->builtin.empty());
+
+    // and one that might never be rebound to an operator is just what it
+    // was.
+    pants::annotate::DataStore store4;
+    optimize("if false {println := +}\ng = {|b| println(b, 1)}\ng(1)\n",
+        store4);
+    call = first_call(function_of(store4, "b")->expression);
+    CPPUNIT_ASSERT(call && call->builtin.empty());
+
+    // so is a while that isn't the builtin.
+    pants::annotate::DataStore store3;
+    optimize("f = {|a| while {a} {a}}\nwhile = {|x, y| x}\n"
+        "g = {|b| while {b} {b}}\nf(g(1))\n", store3);
+    call = first_call(function_of(store3, "a")->expression);
+    CPPUNIT_ASSERT(call && call->builtin == "while");
+    call = first_call(function_of(store3, "b")->expression);
+    CPPUNIT_ASSERT(call && call->builtin.empty());
+  }
+
+  // the varid of the top-level variable called name.
+  unsigned int varid_of(PTR<pants::cps::Expression> cps,
+      const std::string& name) {
+    while(cps) {
+      if(pants::cps::Assignment* assignment =
+          dynamic_cast<pants::cps::Assignment*>(cps.get())) {
+        if(assignment->assignee->name == pants::cps::Name(name, true))
+          return assignment->assignee->getVarid();
+        cps = assignment->next_expression;
+      } else if(pants::cps::Call* call =
+          dynamic_cast<pants::cps::Call*>(cps.get())) {
+        if(!call->continuation) break;
+        cps = call->continuation->expression;
+      } else {
+        cps = dynamic_cast<pants::cps::ObjectMutation*>(
+            cps.get())->next_expression;
+      }
+    }
+    CPPUNIT_FAIL("no such variable");
+    return 0;
+  }
+
+  // the type of the top-level variable called name.
+  pants::annotate::DataStore::Type type_of(PTR<pants::cps::Expression> cps,
+      const pants::annotate::DataStore& store, const std::string& name) {
+    return store.type(varid_of(cps, name));
+  }
+
+  void testTypes() {
+    pants::annotate::DataStore store;
+    PTR<pants::cps::Expression> cps(optimize("n = 1\nm = n +. 2\n"
+        "x = 1.5\nx := x *. 2.0\nmixed = 1\nmixed := 2.5\nb = n <. m\n"
+        "e = 1\nbump = {e := e +. 1}\ny = y +. 1\n"
+        "print(n, m, x, mixed, b, bump(), y)\n", store));
+    CPPUNIT_ASSERT(type_of(cps, store, "n") ==
+        pants::annotate::DataStore::INTEGER);
+    CPPUNIT_ASSERT(type_of(cps, store, "m") ==
+        pants::annotate::DataStore::INTEGER);
+    CPPUNIT_ASSERT(type_of(cps, store, "x") ==
+        pants::annotate::DataStore::FLOAT);
+    CPPUNIT_ASSERT(type_of(cps, store, "mixed") ==
+        pants::annotate::DataStore::UNKNOWN);
+    CPPUNIT_ASSERT(type_of(cps, store, "b") ==
+        pants::annotate::DataStore::BOOLEAN);
+    CPPUNIT_ASSERT(type_of(cps, store, "e") ==
+        pants::annotate::DataStore::INTEGER);
+    // y is still null when it's first read.
+    CPPUNIT_ASSERT(type_of(cps, store, "y") ==
+        pants::annotate::DataStore::UNKNOWN);
+    // only the names that are one type everywhere and need no cell get
+    // kept raw.
+    CPPUNIT_ASSERT(store.rawType(pants::cps::Name("n", true)) ==
+        pants::annotate::DataStore::INTEGER);
+    CPPUNIT_ASSERT(store.rawType(pants::cps::Name("x", true)) ==
+        pants::annotate::DataStore::FLOAT);
+    CPPUNIT_ASSERT(store.rawType(pants::cps::Name("b", true)) ==
+        pants::annotate::DataStore::UNKNOWN);
+    CPPUNIT_ASSERT(store.rawType(pants::cps::Name("e", true)) ==
+        pants::annotate::DataStore::UNKNOWN);
+
+    // a function isn't whatever its body last assigned, and a name that's
+    // something else in another function isn't raw.
+    pants::annotate::DataStore store2;
+    cps = optimize("f = {z = 1}\ns = 1\nt = {|s| s}\nprint(f, s, t(f))\n",
+        store2);
+    CPPUNIT_ASSERT(type_of(cps, store2, "f") ==
+        pants::annotate::DataStore::UNKNOWN);
+    CPPUNIT_ASSERT(type_of(cps, store2, "s") ==
+        pants::annotate::DataStore::INTEGER);
+    CPPUNIT_ASSERT(store2.rawType(pants::cps::Name("s", true)) ==
+        pants::annotate::DataStore::UNKNOWN);
+  }
+
+  void testFrameEscapes() {
+    pants::annotate::DataStore store;
+    optimize("f = {|a| a +. 1}\ng = {|b| f(b); b}\nh = {|c| f(c)}\n"
+        "k = {|d| while {d} {d}}\nm = {|e| if e {e := cont}; e}\n"
+        "m(k(h(g(1))))\n", store);
+    // only g has anything to come back to once f is done, k's loop comes
+    // back to k's frame, and m's if hands its continuation to a block that
+    // keeps it.
+    CPPUNIT_ASSERT(!function_of(store, "a")->frame_escapes);
+    CPPUNIT_ASSERT(function_of(store, "b")->frame_escapes);
+    CPPUNIT_ASSERT(!function_of(store, "c")->frame_escapes);
+    CPPUNIT_ASSERT(function_of(store, "d")->frame_escapes);
+    CPPUNIT_ASSERT(function_of(store, "e")->frame_escapes);
+  }
+
+  void testEnvironments() {
+    pants::annotate::DataStore store;
+    optimize("f = {|a| println(a); g = {|b| a}; h = {|c| println(c)}\n"
+        "k = {|d| println(a, d)}; g(h(k(1)))}\nf(1)\n", store);
+    pants::cps::Callable* f(function_of(store, "a"));
+    pants::cps::Callable* g(function_of(store, "b"));
+    pants::cps::Callable* h(function_of(store, "c"));
+    pants::cps::Callable* k(function_of(store, "d"));
+    CPPUNIT_ASSERT(f && g && h && k);
+    // the top level has nothing to share, g only needs f's argument, h only
+    // what f was given, and k needs some of both.
+    CPPUNIT_ASSERT(f->environment == pants::cps::Callable::COPIED);
+    CPPUNIT_ASSERT(g->environment == pants::cps::Callable::SHARED_FRAME);
+    CPPUNIT_ASSERT(g->getEnvironmentNames() == f->getFrameNames());
+    CPPUNIT_ASSERT(h->environment == pants::cps::Callable::SHARED_ENV);
+    CPPUNIT_ASSERT(h->getEnvironmentNames() == f->getFreeNames());
+    CPPUNIT_ASSERT(k->environment == pants::cps::Callable::COPIED);
+  }
+
+  void testBoxing() {
+    pants::annotate::DataStore store;
+    PTR<pants::cps::Expression> cps(optimize("n = 1\nn := 2\nx = 1\n"
+        "bump = {x := 3}\nprint(n, x, bump())\n", store));
+    // only x is seen from another function.
+    unsigned int n(varid_of(cps, "n")), x(varid_of(cps, "x"));
+    unsigned int bump(varid_of(cps, "bump"));
+    CPPUNIT_ASSERT(store.isMutated(n) && !store.isBoxed(n));
+    CPPUNIT_ASSERT(store.isMutated(x) && store.isBoxed(x));
+    CPPUNIT_ASSERT(store.isMutated(bump) && !store.isBoxed(bump));
+  }
+
+  void testBranches() {
+    pants::annotate::DataStore store;
+    optimize("f = {|a| if a {println(a)} {x = 2; println(x)}; a}\n"
+        "g = {|b| {b +. 1} @if b}\nh = {|c| blk = {c}; if c blk; blk()}\n"
+        "k = {|d| v = if d {cont 1} {2}; v}\nf(g(h(k(1))))\n", store);
+    // f and g get their blocks written in place, each branch running in
+    // their frame.
+    pants::cps::Call* call(first_call(function_of(store, "a")->expression));
+    CPPUNIT_ASSERT(call && call->builtin == "if" && call->continuation);
+    CPPUNIT_ASSERT(call->branches.size() == 2);
+    CPPUNIT_ASSERT(call->right_positional_args.size() == 1);
+    CPPUNIT_ASSERT(!call->branches[0]->function &&
+        !call->branches[1]->function);
+    // the println in f's branches returns into f.
+    CPPUNIT_ASSERT(function_of(store, "a")->frame_escapes);
+    call = first_call(function_of(store, "b")->expression);
+    CPPUNIT_ASSERT(call && call->tail_call && call->branches.size() == 1);
+    CPPUNIT_ASSERT(call->left_positional_args.empty());
+    CPPUNIT_ASSERT(!function_of(store, "b")->frame_escapes);
+    // h's block is called again afterwards, and k's block hands its
+    // continuation on.
+    call = first_call(function_of(store, "c")->expression);
+    CPPUNIT_ASSERT(call && call->builtin == "if" && call->branches.empty());
+    call = first_call(function_of(store, "d")->expression);
+    CPPUNIT_ASSERT(call && call->builtin == "if" && call->branches.empty());
+  }
+
+  // how many calls marked as builtin cps makes, outside of any function it
+  // makes.
+  unsigned int builtin_calls(PTR<pants::cps::Expression> cps,
+      const std::string& builtin) {
+    unsigned int calls(0);
+    while(cps) {
+      if(pants::cps::Assignment* assignment =
+          dynamic_cast<pants::cps::Assignment*>(cps.get())) {
+        cps = assignment->next_expression;
+      } else if(pants::cps::Call* call =
+          dynamic_cast<pants::cps::Call*>(cps.get())) {
+        if(call->builtin == builtin) ++calls;
+        for(unsigned int i = 0; i < call->branches.size(); ++i)
+          calls += builtin_calls(call->branches[i]->expression, builtin);
+        if(!call->continuation) break;
+        cps = call->continuation->expression;
+      } else {
+        cps = dynamic_cast<pants::cps::ObjectMutation*>(
+            cps.get())->next_expression;
+      }
+    }
+    return calls;
+  }
+
+  void testLoops() {
+    // the top level's own break and continue stand in for the prelude's.
+    const char* src("break = {null}\ncontinue = {null}\n"
+        "f = {|a| while {< a 3} {a := + a 1; if (== a 2) {continue()}\n"
+        "break()}; a}\n"
+        "g = {|b| while {break()} {b}; b}\n"
+        "h = {|c| body = {c}; while {c} body; c}\nf(g(h(1)))\n");
+    pants::annotate::DataStore store;
+    optimize(src, store, true);
+    // f's test and body run in its frame, and its break and continue (even
+    // the one in the if's branch) jump straight to the loop's labels.
+    pants::cps::Callable* f(function_of(store, "a"));
+    pants::cps::Call* call(first_call(f->expression));
+    CPPUNIT_ASSERT(call && call->builtin == "while" && call->continuation);
+    CPPUNIT_ASSERT(call->branches.size() == 2);
+    CPPUNIT_ASSERT(call->right_positional_args.empty());
+    CPPUNIT_ASSERT(call->branches[1]->right_positional_args.size() == 1);
+    CPPUNIT_ASSERT(builtin_calls(f->expression, "break") == 1);
+    CPPUNIT_ASSERT(builtin_calls(f->expression, "continue") == 1);
+    // g's test runs with its caller's dynamic variables, and h's body is
+    // called through a variable.
+    pants::cps::Callable* g(function_of(store, "b"));
+    CPPUNIT_ASSERT(first_call(g->expression)->branches.size() == 2);
+    CPPUNIT_ASSERT(builtin_calls(g->expression, "break") == 0);
+    call = first_call(function_of(store, "c")->expression);
+    CPPUNIT_ASSERT(call && call->builtin == "while" && call->branches.empty());
+
+    // without the prelude, break is just whatever the program made it.
+    pants::annotate::DataStore store2;
+    optimize(src, store2);
+    CPPUNIT_ASSERT(builtin_calls(function_of(store2, "a")->expression,
+        "break") == 0);
+  }
+
+  void testSelfCalls() {
+    pants::annotate::DataStore store;
+    optimize("f = {|a| {f 0} @if a}\ng = {|b| g b 1}\n"
+        "h = {|c| v = if c {h 0} {1}; v}\nf(g(h(1)))\n", store);
+    // f calls itself from a branch that returns where f would have.
+    pants::cps::Callable* f(function_of(store, "a"));
+    pants::cps::Call* call(first_call(f->expression));
+    CPPUNIT_ASSERT(call && call->branches.size() == 1);
+    call = first_call(call->branches[0]->expression);
+    CPPUNIT_ASSERT(call && call->self_call && f->self_called);
+    CPPUNIT_ASSERT(!f->frame_escapes);
+    // g passes too many arguments, and h's branch returns to the if.
+    CPPUNIT_ASSERT(!function_of(store, "b")->self_called);
+    CPPUNIT_ASSERT(!function_of(store, "c")->self_called);
+  }
+
+  void testKeywordSlots() {
+    pants::annotate::DataStore store;
+    PTR<pants::cps::Expression> cps(optimize(
+        "f = {|a, b:2| a}\nf(1, b:3)\ng = {|c| c}\ng(c:4, d:5)\n", store));
+    std::ostringstream os;
+    pants::compile::compile(cps, store, os, false, 1);
+    std::string c(os.str());
+    // f's b goes straight into right slot 1, but g has nowhere for d to go,
+    // so both of g's are handed over as keyword arguments.
+    CPPUNIT_ASSERT(c.find("named_slots[1] = 2ULL;") != std::string::npos);
+    std::string::size_type pos(0);
+    unsigned int keywords(0);
+    while((pos = c.find("add_keyword(&keyword_args, (struct ByteArray)",
+        pos + 1)) != std::string::npos)
+      ++keywords;
+    CPPUNIT_ASSERT(keywords == 2);
+    CPPUNIT_ASSERT(c.find("switch((unsigned int)((keyword_args.data[i].hash")
+        != std::string::npos);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(ParserTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(IRTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(ParserEquivalenceTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(CPSImageTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(AnnotateTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(ModuleTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(OptimizeTest);
 
 int main(int argc, char** argv) {
   CPPUNIT_NS::TextUi::TestRunner runner;
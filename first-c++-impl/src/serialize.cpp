@@ -0,0 +1,449 @@
+#include "serialize.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace pants::cps;
+using pants::serialize::ModuleInfo;
+
+#define CPS_IMAGE_MAGIC "PANTSCPS"
+#define CPS_IMAGE_VERSION 3
+#define NULL_VARIABLE 0
+
+enum Tag {
+  TAG_CALL = 1,
+  TAG_ASSIGNMENT,
+  TAG_OBJECT_MUTATION,
+  TAG_HOLE,
+  TAG_FIELD,
+  TAG_VARIABLE,
+  TAG_INTEGER,
+  TAG_STRING,
+  TAG_FLOAT,
+  TAG_CALLABLE
+};
+
+static Expression* find_hole(Expression* cps) {
+  // the top-level chain only ever continues through next expressions and call
+  // continuations, so the first call without a continuation is the end.
+  // optimize::cps only makes tail calls inside functions.
+  while(true) {
+    Assignment* assignment = dynamic_cast<Assignment*>(cps);
+    if(assignment) { cps = assignment->next_expression.get(); continue; }
+    ObjectMutation* mut = dynamic_cast<ObjectMutation*>(cps);
+    if(mut) { cps = mut->next_expression.get(); continue; }
+    Call* call = dynamic_cast<Call*>(cps);
+    if(!call) throw pants::expectation_failure("unknown cps expression");
+    if(!call->continuation) return call;
+    cps = call->continuation->expression.get();
+  }
+}
+
+class ImageWriter : public ExpressionVisitor, public ValueVisitor {
+  public:
+    ImageWriter(Expression* hole) : m_hole(hole), m_os(&m_body) {}
+
+    void visit(Call* call) {
+      if(call == m_hole) {
+        writeTag(TAG_HOLE);
+        return;
+      }
+      writeTag(TAG_CALL);
+      writeVar(call->callable);
+      writeVars(call->left_positional_args);
+      writeVar(call->left_arbitrary_arg);
+      writeVars(call->right_positional_args);
+      writeNumber(call->right_optional_args.size());
+      for(unsigned int i = 0; i < call->right_optional_args.size(); ++i) {
+        writeName(call->right_optional_args[i].key);
+        writeVar(call->right_optional_args[i].value);
+      }
+      writeVar(call->right_arbitrary_arg);
+      writeVar(call->right_keyword_arg);
+      // images are written before optimize::cps, so nothing it marks on a
+      // call (tail calls, builtins, targets) needs to be kept.
+      if(call->continuation) {
+        call->continuation->accept(this);
+      } else {
+        writeNumber(0);
+      }
+    }
+    void visit(Assignment* assignment) {
+      writeTag(TAG_ASSIGNMENT);
+      writeVar(assignment->assignee);
+      assignment->value->accept(this);
+      writeNumber(assignment->local ? 1 : 0);
+      assignment->next_expression->accept(this);
+    }
+    void visit(ObjectMutation* mut) {
+      writeTag(TAG_OBJECT_MUTATION);
+      writeVar(mut->object);
+      writeName(mut->field);
+      writeVar(mut->value);
+      mut->next_expression->accept(this);
+    }
+
+    void visit(Field* field) {
+      writeTag(TAG_FIELD);
+      writeVar(field->object);
+      writeName(field->field);
+    }
+    void visit(VariableValue* var) {
+      writeTag(TAG_VARIABLE);
+      writeVar(var->variable);
+    }
+    void visit(Integer* integer) {
+      writeTag(TAG_INTEGER);
+      writeRaw(&integer->value, sizeof(integer->value));
+    }
+    void visit(String* str) {
+      writeTag(TAG_STRING);
+      writeNumber(str->byte_oriented ? 1 : 0);
+      writeString(str->value);
+    }
+    void visit(Float* floating) {
+      writeTag(TAG_FLOAT);
+      writeRaw(&floating->value, sizeof(floating->value));
+    }
+    void visit(Callable* func) {
+      writeTag(TAG_CALLABLE);
+      writeNumber(func->function ? 1 : 0);
+      writeVars(func->left_positional_args);
+      writeDefinitions(func->left_optional_args);
+      writeVar(func->left_arbitrary_arg);
+      writeVars(func->right_positional_args);
+      writeDefinitions(func->right_optional_args);
+      writeVar(func->right_arbitrary_arg);
+      writeVar(func->right_keyword_arg);
+      func->expression->accept(this);
+    }
+
+    void finish(unsigned long long ir_varcount, const ModuleInfo& info,
+        std::ostream& os) {
+      std::ostringstream header;
+      m_os = &header;
+      writeRaw(CPS_IMAGE_MAGIC, strlen(CPS_IMAGE_MAGIC));
+      writeNumber(CPS_IMAGE_VERSION);
+      writeString(info.fingerprint);
+      writeNumber(ir_varcount);
+      writeNumber(m_names.size());
+      for(unsigned int i = 0; i < m_names.size(); ++i) {
+        writeNumber(m_names[i].user_provided() ? 1 : 0);
+        writeString(m_names[i].name());
+      }
+      writeStrings(info.imports);
+      writeStrings(info.exports);
+      m_os = &m_body;
+      os << header.str() << m_body.str();
+    }
+
+  private:
+    void writeRaw(const void* data, unsigned int size)
+      { m_os->write((const char*)data, size); }
+    void writeNumber(unsigned long long number) {
+      // little-endian base 128, so small counts and indices take one byte
+      do {
+        unsigned char byte = number & 0x7f;
+        number >>= 7;
+        if(number) byte |= 0x80;
+        m_os->put(byte);
+      } while(number);
+    }
+    void writeTag(Tag tag) { writeNumber(tag); }
+    void writeString(const std::string& str) {
+      writeNumber(str.size());
+      writeRaw(str.data(), str.size());
+    }
+    void writeStrings(const std::vector<std::string>& strs) {
+      writeNumber(strs.size());
+      for(unsigned int i = 0; i < strs.size(); ++i) writeString(strs[i]);
+    }
+    void writeName(const Name& name) {
+      std::map<Name, unsigned int>::const_iterator it(m_nameIDs.find(name));
+      if(it != m_nameIDs.end()) {
+        writeNumber(it->second);
+        return;
+      }
+      m_names.push_back(name);
+      m_nameIDs[name] = m_names.size();
+      writeNumber(m_names.size());
+    }
+    void writeVar(const PTR<Variable>& var) {
+      if(!var) {
+        writeNumber(NULL_VARIABLE);
+        return;
+      }
+      writeName(var->name);
+    }
+    void writeVars(const std::vector<PTR<Variable> >& vars) {
+      writeNumber(vars.size());
+      for(unsigned int i = 0; i < vars.size(); ++i) writeVar(vars[i]);
+    }
+    void writeDefinitions(const std::vector<InDefinition>& defs) {
+      writeNumber(defs.size());
+      for(unsigned int i = 0; i < defs.size(); ++i) {
+        writeVar(defs[i].key);
+        writeVar(defs[i].value);
+      }
+    }
+
+  private:
+    Expression* m_hole;
+    std::ostream* m_os;
+    std::ostringstream m_body;
+    std::vector<Name> m_names;
+    std::map<Name, unsigned int> m_nameIDs;
+};
+
+void pants::serialize::write_cps(PTR<Expression> cps,
+    unsigned long long ir_varcount, std::ostream& os,
+    const ModuleInfo& info) {
+  ImageWriter writer(find_hole(cps.get()));
+  cps->accept(&writer);
+  writer.finish(ir_varcount, info, os);
+}
+
+class ImageReader {
+  public:
+    ImageReader(const char* data, unsigned long long size)
+      : m_pos(data), m_end(data + size), m_hole(NULL) {}
+
+    void readHeader(unsigned long long& ir_varcount, ModuleInfo* info) {
+      unsigned int magic_size = strlen(CPS_IMAGE_MAGIC);
+      if((unsigned long long)(m_end - m_pos) < magic_size ||
+          memcmp(m_pos, CPS_IMAGE_MAGIC, magic_size) != 0)
+        throw pants::expectation_failure("not a cps image");
+      m_pos += magic_size;
+      if(readNumber() != CPS_IMAGE_VERSION)
+        throw pants::expectation_failure("cps image version mismatch");
+      ModuleInfo ignored;
+      if(!info) info = &ignored;
+      info->fingerprint = readString();
+      unsigned long long base = ir_varcount;
+      ir_varcount += readNumber();
+      unsigned long long name_count = readNumber();
+      m_names.reserve(name_count);
+      for(unsigned long long i = 0; i < name_count; ++i) {
+        bool user_provided = readNumber() != 0;
+        m_names.push_back(relocate(readString(), user_provided, base));
+      }
+      readStrings(info->imports);
+      readStrings(info->exports);
+    }
+
+    void readExpression(PTR<Expression>& slot) {
+      switch(readNumber()) {
+        case TAG_HOLE:
+          if(m_hole) throw pants::expectation_failure("cps image has 2 holes");
+          m_hole = &slot;
+          return;
+        case TAG_CALL: {
+          PTR<Call> call(new Call(readVar()));
+          slot = call;
+          readVars(call->left_positional_args);
+          call->left_arbitrary_arg = readVar();
+          readVars(call->right_positional_args);
+          unsigned long long optional_count = readNumber();
+          call->right_optional_args.reserve(optional_count);
+          for(unsigned long long i = 0; i < optional_count; ++i) {
+            const Name& key(readName());
+            call->right_optional_args.push_back(OutDefinition(key, readVar()));
+          }
+          call->right_arbitrary_arg = readVar();
+          call->right_keyword_arg = readVar();
+          unsigned long long tag = readNumber();
+          if(tag == TAG_CALLABLE) {
+            call->continuation = readCallable();
+          } else if(tag != 0) {
+            throw pants::expectation_failure("corrupt cps image");
+          }
+          return;
+        }
+        case TAG_ASSIGNMENT: {
+          PTR<Variable> assignee(readVar());
+          PTR<Value> value(readValue());
+          bool local = readNumber() != 0;
+          PTR<Assignment> assignment(new Assignment(assignee, value, local,
+              PTR<Expression>()));
+          slot = assignment;
+          readExpression(assignment->next_expression);
+          return;
+        }
+        case TAG_OBJECT_MUTATION: {
+          PTR<Variable> object(readVar());
+          const Name& field(readName());
+          PTR<ObjectMutation> mut(new ObjectMutation(object, field, readVar(),
+              PTR<Expression>()));
+          slot = mut;
+          readExpression(mut->next_expression);
+          return;
+        }
+        default:
+          throw pants::expectation_failure("corrupt cps image");
+      }
+    }
+
+    PTR<Expression>* hole() const { return m_hole; }
+    bool complete() const { return m_pos == m_end; }
+
+  private:
+    // gensyms are numbered from 1 in every image, so they get moved past
+    // the ones the images and code read before this one already use.
+    static Name relocate(const std::string& name, bool user_provided,
+        unsigned long long base) {
+      unsigned int prefix_size = strlen(GENSYM_PREFIX);
+      if(user_provided || base == 0 ||
+          name.compare(0, prefix_size, GENSYM_PREFIX) != 0)
+        return Name(name, user_provided);
+      char* end;
+      unsigned long long id = strtoull(name.c_str() + prefix_size, &end, 10);
+      if(*end) return Name(name, user_provided);
+      std::ostringstream os;
+      os << GENSYM_PREFIX << id + base;
+      return Name(os.str(), false);
+    }
+
+    PTR<Value> readValue() {
+      switch(readNumber()) {
+        case TAG_FIELD: {
+          PTR<Variable> object(readVar());
+          return PTR<Value>(new Field(object, readName()));
+        }
+        case TAG_VARIABLE:
+          return PTR<Value>(new VariableValue(readVar()));
+        case TAG_INTEGER: {
+          long long value;
+          readRaw(&value, sizeof(value));
+          return PTR<Value>(new Integer(value));
+        }
+        case TAG_STRING: {
+          bool byte_oriented = readNumber() != 0;
+          return PTR<Value>(new String(readString(), byte_oriented));
+        }
+        case TAG_FLOAT: {
+          double value;
+          readRaw(&value, sizeof(value));
+          return PTR<Value>(new Float(value));
+        }
+        case TAG_CALLABLE:
+          return readCallable();
+        default:
+          throw pants::expectation_failure("corrupt cps image");
+      }
+    }
+
+    PTR<Callable> readCallable() {
+      PTR<Callable> func(new Callable(readNumber() != 0));
+      readVars(func->left_positional_args);
+      readDefinitions(func->left_optional_args);
+      func->left_arbitrary_arg = readVar();
+      readVars(func->right_positional_args);
+      readDefinitions(func->right_optional_args);
+      func->right_arbitrary_arg = readVar();
+      func->right_keyword_arg = readVar();
+      readExpression(func->expression);
+      return func;
+    }
+
+    void readRaw(void* data, unsigned int size) {
+      if((unsigned long long)(m_end - m_pos) < size)
+        throw pants::expectation_failure("truncated cps image");
+      memcpy(data, m_pos, size);
+      m_pos += size;
+    }
+    unsigned long long readNumber() {
+      unsigned long long number = 0;
+      for(unsigned int shift = 0; shift < 64; shift += 7) {
+        if(m_pos == m_end)
+          throw pants::expectation_failure("truncated cps image");
+        unsigned char byte = *m_pos++;
+        number |= ((unsigned long long)(byte & 0x7f)) << shift;
+        if(!(byte & 0x80)) return number;
+      }
+      throw pants::expectation_failure("corrupt cps image");
+    }
+    std::string readString() {
+      unsigned long long size = readNumber();
+      if((unsigned long long)(m_end - m_pos) < size)
+        throw pants::expectation_failure("truncated cps image");
+      std::string str(m_pos, size);
+      m_pos += size;
+      return str;
+    }
+    void readStrings(std::vector<std::string>& strs) {
+      unsigned long long count = readNumber();
+      for(unsigned long long i = 0; i < count; ++i)
+        strs.push_back(readString());
+    }
+    const Name& readName() {
+      unsigned long long id = readNumber();
+      if(id == NULL_VARIABLE || id > m_names.size())
+        throw pants::expectation_failure("corrupt cps image");
+      return m_names[id - 1];
+    }
+    PTR<Variable> readVar() {
+      unsigned long long id = readNumber();
+      if(id == NULL_VARIABLE) return PTR<Variable>();
+      if(id > m_names.size())
+        throw pants::expectation_failure("corrupt cps image");
+      return PTR<Variable>(new Variable(m_names[id - 1]));
+    }
+    void readVars(std::vector<PTR<Variable> >& vars) {
+      unsigned long long count = readNumber();
+      vars.reserve(count);
+      for(unsigned long long i = 0; i < count; ++i) vars.push_back(readVar());
+    }
+    void readDefinitions(std::vector<InDefinition>& defs) {
+      unsigned long long count = readNumber();
+      defs.reserve(count);
+      for(unsigned long long i = 0; i < count; ++i) {
+        PTR<Variable> key(readVar());
+        defs.push_back(InDefinition(key, readVar()));
+      }
+    }
+
+  private:
+    const char* m_pos;
+    const char* m_end;
+    std::vector<Name> m_names;
+    PTR<Expression>* m_hole;
+};
+
+void pants::serialize::read_cps(const char* data, unsigned long long size,
+    PTR<Expression>& cps, PTR<Expression>*& hole,
+    unsigned long long& ir_varcount, ModuleInfo* info) {
+  ImageReader reader(data, size);
+  reader.readHeader(ir_varcount, info);
+  reader.readExpression(cps);
+  if(!reader.complete())
+    throw expectation_failure("trailing data in cps image");
+  if(!reader.hole())
+    throw expectation_failure("cps image has no hole");
+  hole = reader.hole();
+}
+
+void pants::serialize::read_cps_file(const std::string& path,
+    PTR<Expression>& cps, PTR<Expression>*& hole,
+    unsigned long long& ir_varcount, ModuleInfo* module_info) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) throw expectation_failure("unable to open " + path);
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    throw expectation_failure("unable to stat " + path);
+  }
+  void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) throw expectation_failure("unable to mmap " + path);
+  try {
+    read_cps((const char*)data, info.st_size, cps, hole, ir_varcount,
+        module_info);
+  } catch (...) {
+    munmap(data, info.st_size);
+    throw;
+  }
+  munmap(data, info.st_size);
+}
@@ -0,0 +1,43 @@
+#ifndef __SERIALIZE_H__
+#define __SERIALIZE_H__
+
+#include "common.h"
+#include "cps.h"
+
+namespace pants {
+namespace serialize {
+
+  // what a module's image records besides its code: the paths it imports,
+  // as written, the top-level names it defines, and a fingerprint of the
+  // compiler that built it.
+  struct ModuleInfo {
+    std::vector<std::string> imports;
+    std::vector<std::string> exports;
+    std::string fingerprint;
+  };
+
+  // writes a compact binary image of a cps tree. the tree's final call (the
+  // one that would hand the last value to the top-level continuation) is
+  // written as a hole that a later program can be spliced into. the ir
+  // gensym counter is stored alongside so spliced code doesn't reuse names.
+  void write_cps(PTR<pants::cps::Expression> cps,
+      unsigned long long ir_varcount, std::ostream& os,
+      const ModuleInfo& info = ModuleInfo());
+
+  // reads a cps image back in. data only needs to be valid for the duration
+  // of the call, so it can be an asset or an mmap'd file. hole is set to the
+  // slot the spliced program should be assigned into. ir_varcount is the
+  // number of gensyms already in use; the image's gensyms are renumbered
+  // past them and ir_varcount is moved past the image's.
+  void read_cps(const char* data, unsigned long long size,
+      PTR<pants::cps::Expression>& cps, PTR<pants::cps::Expression>*& hole,
+      unsigned long long& ir_varcount, ModuleInfo* info = NULL);
+
+  // mmaps path and reads it with read_cps.
+  void read_cps_file(const std::string& path,
+      PTR<pants::cps::Expression>& cps, PTR<pants::cps::Expression>*& hole,
+      unsigned long long& ir_varcount, ModuleInfo* info = NULL);
+
+}}
+
+#endif
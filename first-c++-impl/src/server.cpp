@@ -0,0 +1,249 @@
+#include "server.h"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace pants;
+
+// a request is the client's working directory and then its arguments, one
+// per line and ended by an empty line, followed by the source up until the
+// client shuts down its end. the response is "<status> <out bytes> <err
+// bytes>\n" followed by the two outputs.
+
+static void write_all(int fd, const std::string& data) {
+  const char* pos = data.data();
+  const char* end = pos + data.size();
+  while(pos < end) {
+    ssize_t written = write(fd, pos, end - pos);
+    if(written < 0) {
+      if(errno == EINTR) continue;
+      throw expectation_failure(std::string("write failed: ") +
+          strerror(errno));
+    }
+    pos += written;
+  }
+}
+
+static void read_all(int fd, std::string& data) {
+  char buffer[1 << 16];
+  while(true) {
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    if(got < 0) {
+      if(errno == EINTR) continue;
+      throw expectation_failure(std::string("read failed: ") +
+          strerror(errno));
+    }
+    if(got == 0) return;
+    data.append(buffer, got);
+  }
+}
+
+static sockaddr_un address(const std::string& path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path))
+    throw expectation_failure("socket path too long: " + path);
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  return addr;
+}
+
+static int open_socket() {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) {
+    throw expectation_failure(std::string("unable to make a socket: ") +
+        strerror(errno));
+  }
+  return fd;
+}
+
+// returns -1 if nobody is listening.
+static int connect_to(const std::string& path) {
+  sockaddr_un addr(address(path));
+  int fd = open_socket();
+  if(connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// the default socket is at a name anyone can guess, so before handing a
+// server our source, make sure both the socket and whoever is listening on
+// it belong to us.
+static void check_owner(const std::string& path) {
+  struct stat info;
+  if(lstat(path.c_str(), &info) != 0)
+    throw expectation_failure("no server listening on " + path);
+  if(!S_ISSOCK(info.st_mode))
+    throw expectation_failure(path + " is not a socket");
+  if(info.st_uid != getuid())
+    throw expectation_failure(path + " belongs to another user");
+}
+
+static void check_peer(int fd, const std::string& path) {
+#ifdef SO_PEERCRED
+  struct ucred peer;
+  socklen_t size = sizeof(peer);
+  if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) != 0 ||
+      peer.uid != getuid()) {
+    close(fd);
+    throw expectation_failure("the server on " + path +
+        " belongs to another user");
+  }
+#endif
+}
+
+std::string pants::server::default_socket() {
+  const char* path = getenv("PANTS_SOCKET");
+  if(path && *path) return path;
+  std::ostringstream os;
+  os << "/tmp/pants-" << getuid() << ".sock";
+  return os.str();
+}
+
+static void handle(int fd, server::Handler& handler) {
+  std::string request;
+  read_all(fd, request);
+  std::vector<std::string> lines;
+  std::string::size_type pos = 0;
+  while(true) {
+    std::string::size_type newline = request.find('\n', pos);
+    if(newline == std::string::npos)
+      throw expectation_failure("truncated request");
+    if(newline == pos) break;
+    lines.push_back(request.substr(pos, newline - pos));
+    pos = newline + 1;
+  }
+  if(lines.empty()) throw expectation_failure("request has no directory");
+
+  std::ostringstream out, err;
+  int status = 1;
+  if(chdir(lines[0].c_str()) != 0) {
+    err << "failure: unable to change to " << lines[0] << std::endl;
+  } else {
+    status = handler(std::vector<std::string>(lines.begin() + 1,
+        lines.end()), request.substr(pos + 1), out, err);
+  }
+
+  std::ostringstream header;
+  header << status << " " << out.str().size() << " " << err.str().size()
+         << "\n";
+  write_all(fd, header.str());
+  write_all(fd, out.str());
+  write_all(fd, err.str());
+}
+
+void pants::server::serve(const std::string& path, Handler handler,
+    unsigned int concurrency) {
+  sockaddr_un addr(address(path));
+  int probe = connect_to(path);
+  if(probe >= 0) {
+    close(probe);
+    throw expectation_failure("a server is already listening on " + path);
+  }
+  unlink(path.c_str());
+
+  // only this user gets to talk to the server.
+  int listener = open_socket();
+  mode_t mask = umask(077);
+  int bound = bind(listener, (sockaddr*)&addr, sizeof(addr));
+  umask(mask);
+  if(bound != 0 || listen(listener, SOMAXCONN) != 0) {
+    throw expectation_failure("unable to listen on " + path + ": " +
+        strerror(errno));
+  }
+
+  if(concurrency == 0) concurrency = 1;
+  unsigned int running = 0;
+  while(true) {
+    // reap finished requests, waiting on one if there are too many going.
+    while(running > 0) {
+      pid_t pid = waitpid(-1, NULL, running < concurrency ? WNOHANG : 0);
+      if(pid > 0) {
+        --running;
+      } else if(pid < 0 && errno != EINTR) {
+        running = 0;
+      } else if(pid == 0) {
+        break;
+      }
+    }
+
+    int client = accept(listener, NULL, NULL);
+    if(client < 0) {
+      if(errno == EINTR || errno == ECONNABORTED) continue;
+      throw expectation_failure(std::string("accept failed: ") +
+          strerror(errno));
+    }
+
+    pid_t pid = fork();
+    if(pid == 0) {
+      close(listener);
+      int status = 0;
+      try {
+        handle(client, handler);
+      } catch (const std::exception& e) {
+        status = 1;
+      }
+      // skip tearing down the arenas, the client is waiting on the close.
+      _exit(status);
+    }
+    close(client);
+    if(pid < 0) {
+      std::cerr << "failure: unable to fork: " << strerror(errno)
+                << std::endl;
+    } else {
+      ++running;
+    }
+  }
+}
+
+int pants::server::request(const std::string& path,
+    const std::vector<std::string>& args, std::istream& in,
+    std::ostream& out, std::ostream& err) {
+  char cwd[PATH_MAX];
+  if(!getcwd(cwd, sizeof(cwd)))
+    throw expectation_failure("unable to find the working directory");
+  std::ostringstream request;
+  request << cwd << '\n';
+  for(unsigned int i = 0; i < args.size(); ++i) {
+    if(args[i].empty() || args[i].find('\n') != std::string::npos)
+      throw expectation_failure("arguments can't be empty or have newlines");
+    request << args[i] << '\n';
+  }
+  request << '\n' << in.rdbuf();
+
+  check_owner(path);
+  int fd = connect_to(path);
+  if(fd < 0) throw expectation_failure("no server listening on " + path);
+  check_peer(fd, path);
+  std::string response;
+  try {
+    write_all(fd, request.str());
+    shutdown(fd, SHUT_WR);
+    read_all(fd, response);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  std::string::size_type newline = response.find('\n');
+  if(newline == std::string::npos)
+    throw expectation_failure("server hung up");
+  std::istringstream header(response.substr(0, newline));
+  int status;
+  unsigned long long out_bytes, err_bytes;
+  if(!(header >> status >> out_bytes >> err_bytes) ||
+      response.size() - newline - 1 != out_bytes + err_bytes)
+    throw expectation_failure("bad response from server");
+  out.write(response.data() + newline + 1, out_bytes);
+  err.write(response.data() + newline + 1 + out_bytes, err_bytes);
+  return status;
+}
@@ -0,0 +1,36 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "common.h"
+#include <iostream>
+#include <boost/function.hpp>
+
+namespace pants {
+namespace server {
+
+  // runs one compile: the client's command line arguments and its source.
+  // the handler is called in the client's working directory and returns the
+  // exit status the client should have.
+  typedef boost::function<int(const std::vector<std::string>& args,
+      const std::string& source, std::ostream& out, std::ostream& err)>
+      Handler;
+
+  // $PANTS_SOCKET, or a per-user socket in /tmp.
+  std::string default_socket();
+
+  // listens on a unix socket at path and never returns. every request is
+  // handled in a child forked off the server, so whatever was set up before
+  // calling serve comes for free, and a request can scribble on it without
+  // bothering the next one. at most concurrency requests run at once.
+  void serve(const std::string& path, Handler handler,
+      unsigned int concurrency);
+
+  // sends args and everything in in to the server at path, copying what the
+  // compile writes to out and err. returns the compile's exit status.
+  // refuses to talk to a socket or server owned by another user.
+  int request(const std::string& path, const std::vector<std::string>& args,
+      std::istream& in, std::ostream& out, std::ostream& err);
+
+}}
+
+#endif
@@ -0,0 +1,94 @@
+#include "timing.h"
+#include <cstdio>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+using namespace pants::timing;
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;
+}
+
+void Report::start(const std::string& pass) {
+  m_passes.push_back(Pass(pass));
+  m_start = now();
+}
+
+void Report::stop() {
+  if(m_passes.empty()) throw expectation_failure("no pass started");
+  m_passes.back().seconds = now() - m_start;
+  m_passes.back().peak_rss_kb = peak_rss_kb();
+}
+
+void Report::count(const std::string& counter, unsigned long long value) {
+  if(m_passes.empty()) throw expectation_failure("no pass started");
+  m_passes.back().counters.push_back(std::make_pair(counter, value));
+}
+
+void Report::write(std::ostream& os) const {
+  char buf[128];
+  double total = 0;
+  snprintf(buf, sizeof(buf), "%-18s %10s %12s\n", "pass", "seconds",
+      "peak rss kb");
+  os << buf;
+  for(unsigned int i = 0; i < m_passes.size(); ++i) {
+    const Pass& pass(m_passes[i]);
+    total += pass.seconds;
+    snprintf(buf, sizeof(buf), "%-18s %10.4f %12ld", pass.name.c_str(),
+        pass.seconds, pass.peak_rss_kb);
+    os << buf;
+    for(unsigned int j = 0; j < pass.counters.size(); ++j) {
+      os << (j == 0 ? "  " : ", ") << pass.counters[j].first << " "
+         << pass.counters[j].second;
+    }
+    os << "\n";
+  }
+  snprintf(buf, sizeof(buf), "%-18s %10.4f\n", "total", total);
+  os << buf;
+}
+
+// pass and counter names are all plain identifiers, so there's nothing to
+// escape.
+void Report::writeJSON(std::ostream& os) const {
+  char buf[64];
+  double total = 0;
+  os << "{\"passes\": [";
+  for(unsigned int i = 0; i < m_passes.size(); ++i) {
+    const Pass& pass(m_passes[i]);
+    total += pass.seconds;
+    snprintf(buf, sizeof(buf), "%.6f", pass.seconds);
+    os << (i == 0 ? "\n" : ",\n")
+       << "  {\"name\": \"" << pass.name << "\", \"seconds\": " << buf
+       << ", \"peak_rss_kb\": " << pass.peak_rss_kb << ", \"counters\": {";
+    for(unsigned int j = 0; j < pass.counters.size(); ++j) {
+      os << (j == 0 ? "" : ", ") << "\"" << pass.counters[j].first << "\": "
+         << pass.counters[j].second;
+    }
+    os << "}}";
+  }
+  snprintf(buf, sizeof(buf), "%.6f", total);
+  os << "\n], \"total_seconds\": " << buf << "}\n";
+}
+
+int CountingBuffer::overflow(int c) {
+  if(c == traits_type::eof()) return traits_type::not_eof(c);
+  if(m_target->sputc(traits_type::to_char_type(c)) == traits_type::eof())
+    return traits_type::eof();
+  ++m_bytes;
+  return c;
+}
+
+std::streamsize CountingBuffer::xsputn(const char* data,
+    std::streamsize size) {
+  std::streamsize written(m_target->sputn(data, size));
+  m_bytes += written;
+  return written;
+}
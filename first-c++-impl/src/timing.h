@@ -0,0 +1,50 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#include "common.h"
+#include <streambuf>
+
+namespace pants {
+namespace timing {
+
+  // collects wall time, peak memory and whatever counters each compiler pass
+  // wants to report, for --time-passes. counters attach to the most recently
+  // started pass.
+  class Report : boost::noncopyable {
+    public:
+      Report() : m_start(0) {}
+      void start(const std::string& pass);
+      void stop();
+      void count(const std::string& counter, unsigned long long value);
+      void write(std::ostream& os) const;
+      void writeJSON(std::ostream& os) const;
+    private:
+      struct Pass {
+        Pass(const std::string& name_)
+          : name(name_), seconds(0), peak_rss_kb(0) {}
+        std::string name;
+        double seconds;
+        long peak_rss_kb;
+        std::vector<std::pair<std::string, unsigned long long> > counters;
+      };
+      std::vector<Pass> m_passes;
+      double m_start;
+  };
+
+  // passes everything through to another buffer, counting bytes on the way.
+  class CountingBuffer : public std::streambuf {
+    public:
+      CountingBuffer(std::streambuf* target) : m_target(target), m_bytes(0) {}
+      unsigned long long bytes() const { return m_bytes; }
+    protected:
+      int overflow(int c);
+      std::streamsize xsputn(const char* data, std::streamsize size);
+      int sync() { return m_target->pubsync(); }
+    private:
+      std::streambuf* m_target;
+      unsigned long long m_bytes;
+  };
+
+}}
+
+#endif
@@ -25,6 +25,8 @@ void pants::wrap::ir_prepend(std::vector<PTR<Expression> >& ir) {
   BIND_NAME("new_object");
   BIND_NAME("seal_object");
   BIND_NAME("if");
+  BIND_NAME("while");
+  BIND_NAME("while_dynamic_var");
   BIND_NAME("register_main");
   BIND_NAME("print");
   BIND_NAME("type");
@@ -61,6 +63,8 @@ void pants::wrap::provided_names(std::set<Name>& names) {
   ADD_NAME("new_object");
   ADD_NAME("seal_object");
   ADD_NAME("if");
+  ADD_NAME("while");
+  ADD_NAME("while_dynamic_var");
   ADD_NAME("register_main");
   ADD_NAME("print");
   ADD_NAME("println");